@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <string>
+#include <vector>
+
+using std::vector;
+using std::string;
+
+/*
+*keys of one animated node, times and values live in separate arrays
+*so the key search only walks the (small) time array
+*/
+struct AnimationChannel {
+	int node;	//index into Model::nodes
+	vector<float> positionTimes;
+	vector<glm::vec3> positions;
+	vector<float> rotationTimes;
+	vector<glm::quat> rotations;
+	vector<float> scaleTimes;
+	vector<glm::vec3> scales;
+};
+
+struct Animation {
+	string name;
+	float duration;			//in ticks
+	float ticksPerSecond;
+	vector<AnimationChannel> channels;
+	vector<int> nodeChannels;	//per model node, -1 when the node keeps its bind transform
+};
+
+//index of the last key at or before time, starting from the previous result
+inline unsigned int findKey(const float *times, unsigned int count, float time, unsigned int cursor)
+{
+	//the animation looped or jumped backwards
+	if (cursor >= count || times[cursor] > time)
+		cursor = 0;
+	while (cursor + 1 < count && times[cursor + 1] <= time)
+		++cursor;
+	return cursor;
+}
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "shadervariants.h"
+#include "camera.h"
+#include "model.h"
+#include "scene.h"
+#include "headless.h"
+#include "renderstats.h"
+#include "glext.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cfloat>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+/*
+*render benchmark, run from the project directory so the shader and resource paths resolve
+*benchmark [--frames N] [--output FILE] [--model NAME PATH]...
+*every model flies the same scripted camera paths offscreen and the results are written as json
+*/
+
+const unsigned int WIDTH = 800;
+const unsigned int HEIGHT = 600;
+const float FRAME_TIME = 1.0f / 60.0f;
+const float LOD_PIXEL_ERROR = 1.0f;
+//lit by the directional light and a camera spot light only
+const ShaderPermutation BENCHMARK_PERMUTATION(0, 0);
+
+struct BenchmarkModel {
+	string name;
+	string path;
+};
+
+//obj files are not tracked with their textures, missing models are reported instead of failing the run
+const BenchmarkModel BUNDLED_MODELS[] = {
+	{ "ce", "resources/objects/ce/ce.obj" },
+	{ "nanosuit", "resources/objects/nanosuit/nanosuit.obj" },
+	{ "IronMan", "resources/objects/IronMan/IronMan.obj" },
+	{ "furniture", "resources/objects/furniture/furniture.obj" },
+	{ "horse", "resources/objects/horse/ylm.FBX" },
+};
+
+//orbit around the model's bounds, distance and height are in bounding radii
+struct Flight {
+	const char *name;
+	float distance;
+	float height;
+	float dolly;
+};
+
+const Flight FLIGHTS[] = {
+	{ "orbit", 2.5f, 0.3f, 0.0f },
+	{ "dolly", 2.0f, 0.6f, 0.6f },
+	{ "closeup", 1.2f, 0.1f, 0.2f },
+};
+
+struct FlightResult {
+	string name;
+	FrameTimings timings;
+	RenderStats totals;	//summed over all frames
+	double vertexMs = 0.0;	//summed gpu time of the vertex stage alone
+};
+
+struct ModelResult {
+	BenchmarkModel model;
+	string status;
+	double loadMs = 0.0;
+	unsigned int meshes = 0;
+	unsigned int triangles = 0;
+	double peakMemoryMB = 0.0;
+	vector<FlightResult> flights;
+};
+
+double peakMemoryMB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0.0;
+	return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+	//kilobytes on linux
+	return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+string jsonString(const string &value)
+{
+	string out = "\"";
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		if ((unsigned char)c >= 0x20)
+			out += c;
+	}
+	return out + "\"";
+}
+
+void writeJson(std::ostream &out, const string &renderer, unsigned int frames, const ShaderVariants &shaders, const vector<ModelResult> &results)
+{
+	out << "{\n  \"renderer\": " << jsonString(renderer) << ",\n  \"width\": " << WIDTH << ",\n  \"height\": " << HEIGHT
+		<< ",\n  \"framesPerFlight\": " << frames << ",\n  \"shaderMs\": " << shaders.loadMs()
+		<< ",\n  \"shaderVariants\": " << shaders.size()
+		<< ",\n  \"peakMemoryMB\": " << peakMemoryMB() << ",\n  \"models\": [";
+	for (size_t m = 0; m < results.size(); ++m)
+	{
+		const ModelResult &result = results[m];
+		out << (m ? "," : "") << "\n    {\n      \"name\": " << jsonString(result.model.name)
+			<< ",\n      \"path\": " << jsonString(result.model.path)
+			<< ",\n      \"status\": " << jsonString(result.status)
+			<< ",\n      \"loadMs\": " << result.loadMs
+			<< ",\n      \"meshes\": " << result.meshes
+			<< ",\n      \"triangles\": " << result.triangles
+			<< ",\n      \"peakMemoryMB\": " << result.peakMemoryMB
+			<< ",\n      \"flights\": [";
+		for (size_t f = 0; f < result.flights.size(); ++f)
+		{
+			const FlightResult &flight = result.flights[f];
+			size_t count = std::max(flight.timings.frames.size(), (size_t)1);
+			out << (f ? "," : "") << "\n        { \"name\": " << jsonString(flight.name)
+				<< ", \"frames\": " << flight.timings.frames.size()
+				<< ", \"meanMs\": " << flight.timings.mean()
+				<< ", \"p50Ms\": " << flight.timings.percentile(50.0)
+				<< ", \"p95Ms\": " << flight.timings.percentile(95.0)
+				<< ", \"p99Ms\": " << flight.timings.percentile(99.0)
+				<< ", \"maxMs\": " << flight.timings.percentile(100.0)
+				<< ", \"drawCalls\": " << (double)flight.totals.drawCalls / count
+				<< ", \"stateChanges\": " << (double)flight.totals.stateChanges() / count
+				<< ", \"programBinds\": " << (double)flight.totals.programBinds / count
+				<< ", \"textureBinds\": " << (double)flight.totals.textureBinds / count
+				<< ", \"vertexArrayBinds\": " << (double)flight.totals.vertexArrayBinds / count
+				<< ", \"triangles\": " << (double)flight.totals.triangles / count
+				<< ", \"vertexMs\": " << flight.vertexMs / count << " }";
+		}
+		out << (result.flights.empty() ? "]" : "\n      ]") << "\n    }";
+	}
+	out << "\n  ]\n}\n";
+}
+
+//bounding sphere of all meshes placed by the graph
+void sceneBounds(const SceneGraph &scene, glm::vec3 &center, float &radius)
+{
+	glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+	for (const SceneNode &node : scene.nodes)
+	{
+		for (unsigned int mesh : node.meshes)
+		{
+			const Mesh &m = node.model->meshes[mesh];
+			float scale = glm::max(glm::length(glm::vec3(node.world[0])), glm::max(glm::length(glm::vec3(node.world[1])), glm::length(glm::vec3(node.world[2]))));
+			glm::vec3 c = glm::vec3(node.world * glm::vec4(m.center, 1.0f));
+			minPos = glm::min(minPos, c - glm::vec3(m.radius * scale));
+			maxPos = glm::max(maxPos, c + glm::vec3(m.radius * scale));
+		}
+	}
+	center = (minPos + maxPos) * 0.5f;
+	radius = glm::max(glm::length(maxPos - minPos) * 0.5f, 0.001f);
+}
+
+/*
+*gpu time of the scene with rasterization discarded, only vertex fetch and the vertex shader run
+*measured outside the timed frame, the query result is read back right away
+*/
+double vertexStageMs(SceneGraph &scene, ShaderVariants &shaders, unsigned int query)
+{
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBeginQuery(GL_TIME_ELAPSED, query);
+	scene.draw(shaders, BENCHMARK_PERMUTATION);
+	glEndQuery(GL_TIME_ELAPSED);
+	glDisable(GL_RASTERIZER_DISCARD);
+	GLuint64 ns = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+	return ns / 1000000.0;
+}
+
+void runModel(ModelResult &result, ShaderVariants &shaders, OffscreenTarget &target, unsigned int frames)
+{
+	if (!std::ifstream(result.model.path))
+	{
+		result.status = "missing";
+		std::cout << result.model.name << ": " << result.model.path << " not found, skipped" << std::endl;
+		return;
+	}
+
+	double loadStart = glfwGetTime();
+	Model model(result.model.path);
+	result.loadMs = (glfwGetTime() - loadStart) * 1000.0;
+	if (model.meshes.empty())
+	{
+		result.status = "failed";
+		return;
+	}
+	result.status = "ok";
+	result.meshes = (unsigned int)model.meshes.size();
+	for (const Mesh &mesh : model.meshes)
+		result.triangles += mesh.triangleCount(0);
+
+	model.prepareShaders(shaders, BENCHMARK_PERMUTATION);
+	shaders.finish();
+
+	SceneGraph scene;
+	scene.addModel(model, -1, glm::mat4(1.0f));
+	scene.update();
+	glm::vec3 center;
+	float radius;
+	sceneBounds(scene, center, radius);
+
+	Camera camera(glm::vec3(0.0f), false);
+	glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)WIDTH / (float)HEIGHT, radius * 0.01f, radius * 10.0f);
+	unsigned int vertexQuery;
+	glGenQueries(1, &vertexQuery);
+
+	for (const Flight &flight : FLIGHTS)
+	{
+		FlightResult flightResult;
+		flightResult.name = flight.name;
+
+		//one revolution per flight
+		CameraPath path;
+		path.target = center;
+		path.radius = radius * flight.distance;
+		path.height = radius * flight.height;
+		path.dolly = flight.dolly;
+		path.period = frames * FRAME_TIME;
+
+		for (unsigned int frame = 0; frame < frames; ++frame)
+		{
+			double frameStart = glfwGetTime();
+			renderStats() = RenderStats();
+			path.apply(camera, frame * FRAME_TIME);
+			target.bind();
+
+			glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			scene.selectLod(camera.position, glm::radians(camera.zoom), (float)HEIGHT, LOD_PIXEL_ERROR);
+			scene.setViewProjection(projection * camera.getViewMatrix());
+			shaders.setFrameUniforms([&](Shader &shader) {
+				shader.setMat4("projection", projection);
+				shader.setMat4("view", camera.getViewMatrix());
+				shader.setFloat("material.shininess", 32.0f);
+				shader.setVec3("viewPos", camera.position);
+				shader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
+				shader.setVec3("dirLight.diffuse", 0.8f, 0.8f, 0.8f);
+				shader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+				shader.setVec3("spotLight.position", camera.position);
+				shader.setVec3("spotLight.direction", camera.front);
+				shader.setVec3("spotLight.diffuse", 0.8f, 0.8f, 0.8f);
+				shader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
+				shader.setFloat("spotLight.constant", 1.0f);
+				shader.setFloat("spotLight.linear", 0.09f);
+				shader.setFloat("spotLight.quadratic", 0.032f);
+				shader.setFloat("spotLight.cutoff", glm::cos(glm::radians(10.0f)));
+				shader.setFloat("spotLight.outerCutoff", glm::cos(glm::radians(15.0f)));
+			});
+			scene.draw(shaders, BENCHMARK_PERMUTATION);
+
+			//wait for the gpu so the time covers the whole frame
+			glFinish();
+			flightResult.timings.add((glfwGetTime() - frameStart) * 1000.0);
+
+			const RenderStats &stats = renderStats();
+			flightResult.totals.drawCalls += stats.drawCalls;
+			flightResult.totals.triangles += stats.triangles;
+			flightResult.totals.programBinds += stats.programBinds;
+			flightResult.totals.textureBinds += stats.textureBinds;
+			flightResult.totals.vertexArrayBinds += stats.vertexArrayBinds;
+
+			flightResult.vertexMs += vertexStageMs(scene, shaders, vertexQuery);
+		}
+
+		std::cout << result.model.name << " " << flight.name << ": vertex stage "
+			<< flightResult.vertexMs / std::max(frames, 1u) << " ms, ";
+		flightResult.timings.report(std::cout);
+		result.flights.push_back(flightResult);
+	}
+	glDeleteQueries(1, &vertexQuery);
+	result.peakMemoryMB = peakMemoryMB();
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int frames = 300;
+	string outputPath = "benchmark.json";
+	vector<BenchmarkModel> models;
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc)
+			frames = std::max(std::atoi(argv[++i]), 1);
+		else if (arg == "--output" && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (arg == "--model" && i + 2 < argc)
+		{
+			models.push_back({ argv[i + 1], argv[i + 2] });
+			i += 2;
+		}
+		else
+			std::cout << "unknown argument " << arg << std::endl;
+	}
+	if (models.empty())
+		models.assign(std::begin(BUNDLED_MODELS), std::end(BUNDLED_MODELS));
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	//same context selection as the headless mode of the viewer
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "benchmark", NULL, NULL);
+	if (!window)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+		window = glfwCreateWindow(WIDTH, HEIGHT, "benchmark", NULL, NULL);
+	}
+	if (!window)
+	{
+		std::cout << "failed to create window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(0);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "failed to init glad" << std::endl;
+		return -1;
+	}
+	loadGLExtensions();
+	glEnable(GL_DEPTH_TEST);
+
+	OffscreenTarget target;
+	if (!target.create(WIDTH, HEIGHT))
+	{
+		glfwTerminate();
+		return -1;
+	}
+	ShaderVariants shaders("shader/vmodel.glsl", "shader/fmodel.glsl");
+	string renderer = (const char*)glGetString(GL_RENDERER);
+	std::cout << "benchmark: " << models.size() << " models, " << frames << " frames per flight on " << renderer << std::endl;
+
+	vector<ModelResult> results;
+	for (const BenchmarkModel &model : models)
+	{
+		ModelResult result;
+		result.model = model;
+		runModel(result, shaders, target, frames);
+		results.push_back(result);
+	}
+
+	std::ofstream file(outputPath, std::ios::trunc);
+	writeJson(file, renderer, frames, shaders, results);
+	if (!file)
+		std::cout << "failed to write " << outputPath << std::endl;
+	else
+		std::cout << "wrote " << outputPath << std::endl;
+
+	glfwTerminate();
+	return 0;
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <vector>
 
@@ -23,6 +24,38 @@ const glm::vec3 POSITION = glm::vec3(0.0f, 0.0f, 0.0f);
 const glm::vec3 WORLDUP = glm::vec3(0.0f, 1.0f, 0.0f);
 const glm::vec3 Front = glm::vec3(0.0f, 0.0f, -1.0f);
 
+//planes of a view projection, normals point inside and are normalized so distances are in world units
+struct Frustum {
+	glm::vec4 planes[6];
+
+	void set(const glm::mat4 &viewProjection)
+	{
+		glm::mat4 m = glm::transpose(viewProjection);
+		planes[0] = m[3] + m[0];	//left
+		planes[1] = m[3] - m[0];	//right
+		planes[2] = m[3] + m[1];	//bottom
+		planes[3] = m[3] - m[1];	//top
+		planes[4] = m[3] + m[2];	//near
+		planes[5] = m[3] - m[2];	//far
+		for (glm::vec4 &plane : planes)
+			plane /= glm::length(glm::vec3(plane));
+	}
+
+	//sphere as (center, radius), conservative near the corners
+	bool intersects(const glm::vec4 &sphere) const
+	{
+		for (const glm::vec4 &plane : planes)
+			if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w)
+				return false;
+		return true;
+	}
+};
+
+/*
+*yaw and pitch are the controls, the orientation they give is kept as a quaternion
+*view, projection, viewProjection and frustum are cached by update and only rebuilt when the camera
+*or the projection changed, version counts the rebuilds so other systems can skip work for a still camera
+*/
 class Camera
 {
 public:
@@ -40,6 +73,15 @@ public:
 	float mouseSensitivity;
 	float zoom;
 	bool lockedY;
+	//camera to world rotation, follows yaw and pitch
+	glm::quat orientation;
+
+	//valid after update
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	Frustum frustum;
+	unsigned int version = 0;	//changes whenever update rebuilt the matrices
 
 	Camera(glm::vec3 _position = POSITION, glm::vec3 _worldUp = WORLDUP, float _yaw = YAW, float _pitch = PITCH, bool _lockedY = false)
 		: front(Front), movementSpeed(SPEED), mouseSensitivity(SENSITIVITY), zoom(ZOOM),
@@ -52,9 +94,26 @@ public:
 		:Camera(_position, WORLDUP, YAW, PITCH, _lockedY)
 	{ }
 
-	glm::mat4 getViewMatrix()
+	//same as view, without the cache
+	glm::mat4 getViewMatrix() const
 	{
-		return glm::lookAt(position, position + front, up);
+		return glm::translate(glm::mat4_cast(glm::conjugate(orientation)), -position);
+	}
+
+	//returns whether the matrices changed since the last call, aspect is of the framebuffer drawn to
+	bool update(float aspect, float nearDistance, float farDistance)
+	{
+		if (version && position == cached.position && orientation == cached.orientation && zoom == cached.zoom
+			&& aspect == cached.aspect && nearDistance == cached.nearDistance && farDistance == cached.farDistance)
+			return false;
+		if (!version || zoom != cached.zoom || aspect != cached.aspect || nearDistance != cached.nearDistance || farDistance != cached.farDistance)
+			projection = glm::perspective(glm::radians(zoom), aspect, nearDistance, farDistance);
+		view = getViewMatrix();
+		viewProjection = projection * view;
+		frustum.set(viewProjection);
+		cached = { position, orientation, zoom, aspect, nearDistance, farDistance };
+		++version;
+		return true;
 	}
 
 	void processKeyboard(move_t direction, float deltaTime)
@@ -98,6 +157,23 @@ public:
 		updateCameraVectors();
 	}
 
+	//turn towards target without moving
+	void lookAt(const glm::vec3 &target)
+	{
+		glm::vec3 direction = glm::normalize(target - position);
+		pitch = glm::degrees(asin(direction.y));
+		yaw = glm::degrees(atan2(direction.z, direction.x));
+		updateCameraVectors();
+	}
+
+	//set the euler angles directly, e.g. from an interpolated state
+	void setOrientation(float _yaw, float _pitch)
+	{
+		yaw = _yaw;
+		pitch = _pitch;
+		updateCameraVectors();
+	}
+
 	void processMouseScroll(float yOffset)
 	{
 		if (zoom >= 1.0f && zoom <= 45.0f)
@@ -109,6 +185,13 @@ public:
 	}
 
 private:
+	//inputs of the cached matrices
+	struct {
+		glm::vec3 position;
+		glm::quat orientation;
+		float zoom, aspect, nearDistance, farDistance;
+	} cached;
+
 	void updateCameraVectors()
 	{
 		glm::vec3 _front;
@@ -118,5 +201,7 @@ private:
 		front = glm::normalize(_front);
 		right = glm::normalize(glm::cross(front, worldUp));
 		up = glm::normalize(glm::cross(right, front));
+		//the camera looks down its -z
+		orientation = glm::normalize(glm::quat_cast(glm::mat3(right, up, -front)));
 	}
 };
\ No newline at end of file
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "jobs.h"
+#include "profiler.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+using std::vector;
+
+//froxel grid, the shaders get the sizes as uniforms
+const unsigned int CLUSTER_X = 16;
+const unsigned int CLUSTER_Y = 9;
+const unsigned int CLUSTER_Z = 24;
+//lights one cluster can reference, the rest are dropped and counted
+const unsigned int CLUSTER_MAX_LIGHTS = 128;
+//texture units of the light buffers, above the ones taken by mesh textures
+const unsigned int CLUSTER_TEXTURE_UNIT = 8;
+
+/*
+*point light when cosOuter <= -1, spot light otherwise
+*the light has no effect past range, see calcClusterLight in shader/clusters.glsl
+*/
+struct ClusterLight {
+	glm::vec3 position;
+	float range;
+	glm::vec3 color;
+	glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	float cosInner = -2.0f;
+	float cosOuter = -2.0f;
+
+	static ClusterLight point(const glm::vec3 &position, const glm::vec3 &color, float range)
+	{
+		ClusterLight light;
+		light.position = position;
+		light.color = color;
+		light.range = range;
+		return light;
+	}
+
+	static ClusterLight spot(const glm::vec3 &position, const glm::vec3 &direction, const glm::vec3 &color, float range, float innerDegrees, float outerDegrees)
+	{
+		ClusterLight light = point(position, color, range);
+		light.direction = glm::normalize(direction);
+		light.cosInner = std::cos(glm::radians(innerDegrees));
+		light.cosOuter = std::cos(glm::radians(outerDegrees));
+		return light;
+	}
+};
+
+struct ClusterStats {
+	unsigned int lights = 0;
+	unsigned int visibleLights = 0;	//in front of the camera and inside the grid depth
+	unsigned int references = 0;	//light indices written
+	unsigned int maxPerCluster = 0;
+	unsigned int dropped = 0;	//references over CLUSTER_MAX_LIGHTS
+};
+
+/*
+*clustered forward lighting
+*the view frustum is split into CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z exponential depth slices,
+*every frame the lights are assigned to the clusters their bounding sphere touches on the job system
+*and the fragment shader only evaluates the lights of its own cluster
+*
+*gl 3.3 has no storage buffers, the lights, the per cluster (offset, count) and the index list
+*are texture buffers read with texelFetch
+*/
+class ClusteredLights
+{
+public:
+	vector<ClusterLight> lights;
+	ClusterStats stats;
+
+	ClusteredLights()
+	{
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+		const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+		for (unsigned int i = 0; i < 3; ++i)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+			glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		ranges.resize(CLUSTER_X * CLUSTER_Y * CLUSTER_Z * 2);
+		slices.resize(CLUSTER_Z);
+
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		setViewport(viewport[2], viewport[3]);
+	}
+
+	//assign lights to clusters and upload the buffers, projection must be a perspective one
+	void update(const glm::mat4 &view, const glm::mat4 &projection, float nearDistance, float farDistance, JobSystem &jobs)
+	{
+		PROFILE_SCOPE("light clusters");
+		if (gridDirty || projection != lastProjection || nearDistance != nearPlane || farDistance != farPlane)
+			buildGrid(projection, nearDistance, farDistance);
+
+		//light bounds in view space, slices first so the jobs only look at the lights reaching them
+		bounds.clear();
+		stats = ClusterStats();
+		stats.lights = (unsigned int)lights.size();
+		for (unsigned int i = 0; i < lights.size(); ++i)
+		{
+			const ClusterLight &light = lights[i];
+			glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+			float zNear = -center.z - light.range, zFar = -center.z + light.range;
+			if (zFar <= nearPlane || zNear >= farPlane)
+				continue;
+			LightBounds b;
+			b.center = center;
+			b.radius = light.range;
+			b.index = i;
+			b.sliceBegin = slice(zNear);
+			b.sliceEnd = slice(zFar) + 1;
+			screenBounds(center, light.range, b);
+			bounds.push_back(b);
+		}
+		stats.visibleLights = (unsigned int)bounds.size();
+
+		jobs.parallelFor(CLUSTER_Z, 1, [&](size_t begin, size_t end, unsigned int) {
+			for (size_t z = begin; z < end; ++z)
+				assignSlice((unsigned int)z);
+		});
+
+		//slices were filled independently, make their offsets global
+		indices.clear();
+		for (unsigned int z = 0; z < CLUSTER_Z; ++z)
+		{
+			const Slice &s = slices[z];
+			unsigned int base = (unsigned int)indices.size();
+			for (unsigned int c = 0; c < CLUSTER_X * CLUSTER_Y; ++c)
+				ranges[((z * CLUSTER_Y * CLUSTER_X) + c) * 2] += base;
+			indices.insert(indices.end(), s.indices.begin(), s.indices.end());
+			stats.maxPerCluster = std::max(stats.maxPerCluster, s.maxCount);
+			stats.dropped += s.dropped;
+		}
+		stats.references = (unsigned int)indices.size();
+
+		upload();
+	}
+
+	//only the light buffer, for passes that do not need the clusters (deferred light volumes)
+	void uploadLights()
+	{
+		lightTexels.resize(lights.size() * 3);
+		for (size_t i = 0; i < lights.size(); ++i)
+		{
+			const ClusterLight &light = lights[i];
+			lightTexels[i * 3] = glm::vec4(light.position, light.range);
+			lightTexels[i * 3 + 1] = glm::vec4(light.color, light.cosInner);
+			lightTexels[i * 3 + 2] = glm::vec4(light.direction, light.cosOuter);
+		}
+		uploadBuffer(buffers[0], lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	//bind the buffers to their texture units, once per frame before drawing
+	void bind() const
+	{
+		for (unsigned int i = 0; i < 3; ++i)
+		{
+			glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT + i);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	//uniforms of shader/clusters.glsl, the shader must be in use
+	void setUniforms(Shader &shader) const
+	{
+		shader.setInt("clusterLights", CLUSTER_TEXTURE_UNIT);
+		shader.setInt("clusterRanges", CLUSTER_TEXTURE_UNIT + 1);
+		shader.setInt("clusterIndices", CLUSTER_TEXTURE_UNIT + 2);
+		glUniform3i(glGetUniformLocation(shader.ID, "clusterGrid"), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+		glUniform2f(glGetUniformLocation(shader.ID, "clusterTileSize"), 1.0f / tileSize.x, 1.0f / tileSize.y);
+		glUniform2f(glGetUniformLocation(shader.ID, "clusterDepth"), depthScale, depthBias);
+	}
+
+	//pixel size of the viewport the clusters are built for, the viewport at construction by default
+	void setViewport(unsigned int width, unsigned int height)
+	{
+		width = std::max(width, 1u);
+		height = std::max(height, 1u);
+		tileSize = glm::vec2(std::ceil((float)width / CLUSTER_X), std::ceil((float)height / CLUSTER_Y));
+		//tiles may overhang the right and top edges when the viewport does not divide evenly
+		ndcTile = 2.0f * tileSize / glm::vec2((float)width, (float)height);
+		gridDirty = true;
+	}
+
+private:
+	struct LightBounds {
+		glm::vec3 center;
+		float radius;
+		unsigned int index;
+		unsigned int sliceBegin, sliceEnd;
+		unsigned int xBegin, xEnd, yBegin, yEnd;
+	};
+
+	struct Slice {
+		vector<unsigned int> hits;	//(cluster, light) pairs
+		vector<unsigned int> indices;
+		unsigned int maxCount = 0;
+		unsigned int dropped = 0;
+	};
+
+	//view space box of every cluster, built when the projection changes
+	struct ClusterBox {
+		glm::vec3 min, max;
+	};
+
+	unsigned int buffers[3], textures[3];
+	glm::mat4 lastProjection = glm::mat4(0.0f);
+	float nearPlane = 0.0f, farPlane = 0.0f;
+	float depthScale = 0.0f, depthBias = 0.0f;
+	glm::vec2 tileSize = glm::vec2(1.0f);
+	glm::vec2 ndcTile = glm::vec2(1.0f);
+	bool gridDirty = true;
+	vector<ClusterBox> boxes;
+	vector<LightBounds> bounds;
+	vector<Slice> slices;
+	vector<unsigned int> ranges;
+	vector<unsigned int> indices;
+	vector<glm::vec4> lightTexels;
+
+	//slice of a positive view depth, same as the shader
+	unsigned int slice(float depth) const
+	{
+		if (depth <= nearPlane)
+			return 0;
+		int s = (int)(std::log(depth) * depthScale + depthBias);
+		return (unsigned int)glm::clamp(s, 0, (int)CLUSTER_Z - 1);
+	}
+
+	void buildGrid(const glm::mat4 &projection, float nearDistance, float farDistance)
+	{
+		lastProjection = projection;
+		gridDirty = false;
+		nearPlane = nearDistance;
+		farPlane = farDistance;
+		//slice = log(depth / near) / log(far / near) * CLUSTER_Z
+		depthScale = CLUSTER_Z / std::log(farDistance / nearDistance);
+		depthBias = -(float)CLUSTER_Z * std::log(nearDistance) / std::log(farDistance / nearDistance);
+
+		float xScale = 1.0f / projection[0][0], yScale = 1.0f / projection[1][1];
+
+		boxes.resize(CLUSTER_X * CLUSTER_Y * CLUSTER_Z);
+		for (unsigned int z = 0; z < CLUSTER_Z; ++z)
+		{
+			float zNear = nearDistance * std::pow(farDistance / nearDistance, (float)z / CLUSTER_Z);
+			float zFar = nearDistance * std::pow(farDistance / nearDistance, (float)(z + 1) / CLUSTER_Z);
+			for (unsigned int y = 0; y < CLUSTER_Y; ++y)
+			{
+				float y0 = (-1.0f + y * ndcTile.y) * yScale, y1 = (-1.0f + (y + 1) * ndcTile.y) * yScale;
+				for (unsigned int x = 0; x < CLUSTER_X; ++x)
+				{
+					float x0 = (-1.0f + x * ndcTile.x) * xScale, x1 = (-1.0f + (x + 1) * ndcTile.x) * xScale;
+					//the tile frustum is widest at the far end of the slice
+					ClusterBox &box = boxes[(z * CLUSTER_Y + y) * CLUSTER_X + x];
+					box.min = glm::vec3(std::min(x0 * zNear, x0 * zFar), std::min(y0 * zNear, y0 * zFar), -zFar);
+					box.max = glm::vec3(std::max(x1 * zNear, x1 * zFar), std::max(y1 * zNear, y1 * zFar), -zNear);
+				}
+			}
+		}
+	}
+
+	//conservative tile range of a view space sphere from the box around it
+	void screenBounds(const glm::vec3 &center, float radius, LightBounds &b) const
+	{
+		b.xBegin = 0, b.xEnd = CLUSTER_X;
+		b.yBegin = 0, b.yEnd = CLUSTER_Y;
+		float zNear = -center.z - radius, zFar = -center.z + radius;
+		if (zNear <= nearPlane)
+			return;
+
+		//x / depth is extreme at the corners of the box
+		float xMin = std::min((center.x - radius) / zNear, (center.x - radius) / zFar) * lastProjection[0][0];
+		float xMax = std::max((center.x + radius) / zNear, (center.x + radius) / zFar) * lastProjection[0][0];
+		float yMin = std::min((center.y - radius) / zNear, (center.y - radius) / zFar) * lastProjection[1][1];
+		float yMax = std::max((center.y + radius) / zNear, (center.y + radius) / zFar) * lastProjection[1][1];
+		b.xBegin = (unsigned int)glm::clamp((int)std::floor((xMin + 1.0f) / ndcTile.x), 0, (int)CLUSTER_X);
+		b.xEnd = (unsigned int)glm::clamp((int)std::floor((xMax + 1.0f) / ndcTile.x) + 1, 0, (int)CLUSTER_X);
+		b.yBegin = (unsigned int)glm::clamp((int)std::floor((yMin + 1.0f) / ndcTile.y), 0, (int)CLUSTER_Y);
+		b.yEnd = (unsigned int)glm::clamp((int)std::floor((yMax + 1.0f) / ndcTile.y) + 1, 0, (int)CLUSTER_Y);
+	}
+
+	//fills ranges of the slice with offsets local to the slice
+	void assignSlice(unsigned int z)
+	{
+		Slice &s = slices[z];
+		s.indices.clear();
+		s.maxCount = 0;
+		s.dropped = 0;
+
+		//per cluster lists of this slice, counted first so the indices come out grouped by cluster
+		unsigned int counts[CLUSTER_X * CLUSTER_Y] = {};
+		vector<unsigned int> &hits = s.hits;
+		hits.clear();
+		for (const LightBounds &b : bounds)
+		{
+			if (z < b.sliceBegin || z >= b.sliceEnd)
+				continue;
+			float radius2 = b.radius * b.radius;
+			for (unsigned int y = b.yBegin; y < b.yEnd; ++y)
+			{
+				for (unsigned int x = b.xBegin; x < b.xEnd; ++x)
+				{
+					unsigned int cluster = y * CLUSTER_X + x;
+					const ClusterBox &box = boxes[z * CLUSTER_Y * CLUSTER_X + cluster];
+					glm::vec3 closest = glm::clamp(b.center, box.min, box.max);
+					glm::vec3 d = closest - b.center;
+					if (glm::dot(d, d) > radius2)
+						continue;
+					hits.push_back(cluster);
+					hits.push_back(b.index);
+					++counts[cluster];
+				}
+			}
+		}
+
+		unsigned int offset = 0;
+		unsigned int *range = &ranges[z * CLUSTER_Y * CLUSTER_X * 2];
+		for (unsigned int c = 0; c < CLUSTER_X * CLUSTER_Y; ++c)
+		{
+			unsigned int count = std::min(counts[c], CLUSTER_MAX_LIGHTS);
+			s.dropped += counts[c] - count;
+			s.maxCount = std::max(s.maxCount, count);
+			range[c * 2] = offset;
+			range[c * 2 + 1] = 0;
+			counts[c] = count;
+			offset += count;
+		}
+		s.indices.resize(offset);
+		for (size_t i = 0; i < hits.size(); i += 2)
+		{
+			unsigned int *r = &range[hits[i] * 2];
+			if (r[1] < counts[hits[i]])
+				s.indices[r[0] + r[1]++] = hits[i + 1];
+		}
+	}
+
+	//orphan and refill, the driver does not wait for last frame's draws
+	void upload()
+	{
+		uploadLights();
+		uploadBuffer(buffers[1], ranges.data(), ranges.size() * sizeof(unsigned int));
+		uploadBuffer(buffers[2], indices.data(), indices.size() * sizeof(unsigned int));
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	static void uploadBuffer(unsigned int buffer, const void *data, size_t size)
+	{
+		//an empty texture buffer is not allowed to be sampled on every driver
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+		if (size > 0)
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	}
+};
\ No newline at end of file
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "shadervariants.h"
+#include "shaderlibrary.h"
+#include "clusters.h"
+#include "renderstats.h"
+
+#include <vector>
+#include <cmath>
+#include <iostream>
+#include <functional>
+
+using std::vector;
+
+//low poly sphere the light volumes are drawn with
+const unsigned int LIGHT_VOLUME_SLICES = 12;
+const unsigned int LIGHT_VOLUME_STACKS = 8;
+
+/*
+*deferred shading, an alternative to the forward model shaders
+*the geometry pass writes a compact g-buffer, 8 bytes per pixel plus depth:
+*  albedo and specular intensity in RGBA8, an octahedral normal in RG16
+*the directional light is a full screen pass, every point and spot light of a ClusteredLights list
+*is an instanced sphere volume shaded only where scene depth lies inside it, so the lighting cost
+*follows the pixels a light covers instead of the overdraw of the geometry
+*/
+class DeferredRenderer
+{
+public:
+	//geometry pass variants, same features as the forward ones
+	ShaderVariants geometryShaders{ "shader/vmodel.glsl", "shader/fgbuffer.glsl" };
+
+	//the lighting programs are added to shaders, finished with the library
+	bool create(unsigned int _width, unsigned int _height, ShaderLibrary &shaders)
+	{
+		width = _width;
+		height = _height;
+
+		glGenFramebuffers(1, &FBO);
+		bool complete = allocate();
+
+		directionalShader = &shaders.add("deferred directional", "shader/vdeferred.glsl", "shader/fdeferred.glsl");
+		shadowedShader = &shaders.add("deferred shadowed", "shader/vdeferred.glsl", "shader/fdeferred.glsl", { "SHADOWS" });
+		volumeShader = &shaders.add("deferred volumes", "shader/vdeferred.glsl", "shader/fdeferred.glsl", { "LIGHT_VOLUME" });
+		createSphere();
+		//the full screen triangle has no attributes, core profile still needs a vertex array
+		glGenVertexArrays(1, &emptyVAO);
+		return complete;
+	}
+
+	//new g-buffer textures for a framebuffer of another size
+	bool resize(unsigned int _width, unsigned int _height)
+	{
+		width = _width;
+		height = _height;
+		const unsigned int textures[3] = { albedoSpecular, normal, depth };
+		glDeleteTextures(3, textures);
+		return allocate();
+	}
+
+	//bind the g-buffer for the geometry pass, the bound framebuffer and viewport receive the lit image
+	void beginGeometry()
+	{
+		GLint bound = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+		target = (unsigned int)bound;
+		glGetIntegerv(GL_VIEWPORT, targetViewport);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glViewport(0, 0, width, height);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	/*
+	*shade the g-buffer into the target framebuffer, its depth is replaced by the scene depth
+	*so forward geometry drawn afterwards is still occluded correctly
+	*lightUniforms sets material, viewPos and dirLight as for the forward shaders, with shadowed
+	*also the cascaded shadow uniforms of the directional pass, the shadow maps must be bound
+	*/
+	void light(ClusteredLights &lights, const glm::mat4 &view, const glm::mat4 &projection, const std::function<void(Shader&)> &lightUniforms,
+		bool shadowed = false)
+	{
+		lights.uploadLights();
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+		glViewport(targetViewport[0], targetViewport[1], targetViewport[2], targetViewport[3]);
+
+		lights.bind();
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, albedoSpecular);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, normal);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, depth);
+		glActiveTexture(GL_TEXTURE0);
+
+		glm::mat4 viewProjection = projection * view;
+		glDepthMask(GL_FALSE);
+
+		//ambient and directional light over every covered pixel
+		glDisable(GL_DEPTH_TEST);
+		setUniforms(shadowed ? *shadowedShader : *directionalShader, viewProjection, lights, lightUniforms);
+		glBindVertexArray(emptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		/*
+		*back faces behind the scene depth, a surface in front of the far side of the sphere gets the light
+		*this also holds with the camera inside the volume, the window in the attenuation
+		*makes surfaces in front of the volume black
+		*/
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_GREATER);
+		//volumes reaching past the far plane are not clipped
+		glEnable(GL_DEPTH_CLAMP);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_FRONT);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		setUniforms(*volumeShader, viewProjection, lights, lightUniforms);
+		glBindVertexArray(sphereVAO);
+		glDrawElementsInstanced(GL_TRIANGLES, sphereCount, GL_UNSIGNED_INT, 0, (GLsizei)lights.lights.size());
+
+		RenderStats &stats = renderStats();
+		stats.drawCalls += 2;
+		stats.triangles += 1 + sphereCount / 3 * (unsigned int)lights.lights.size();
+		stats.textureBinds += 3;
+		stats.vertexArrayBinds += 2;
+
+		glDisable(GL_BLEND);
+		glDisable(GL_DEPTH_CLAMP);
+		glCullFace(GL_BACK);
+		glDisable(GL_CULL_FACE);
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+		glBindVertexArray(0);
+	}
+
+	//of the geometry variants, the lighting programs are counted by the library
+	double loadMs() const
+	{
+		return geometryShaders.loadMs();
+	}
+
+private:
+	unsigned int FBO = 0;
+	unsigned int albedoSpecular = 0, normal = 0, depth = 0;
+	unsigned int width = 0, height = 0;
+	unsigned int target = 0;
+	GLint targetViewport[4] = {};
+	Shader *directionalShader = nullptr, *shadowedShader = nullptr, *volumeShader = nullptr;
+	unsigned int sphereVAO = 0, sphereVBO = 0, sphereEBO = 0, sphereCount = 0;
+	unsigned int emptyVAO = 0;
+
+	bool allocate()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		albedoSpecular = attach(GL_COLOR_ATTACHMENT0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		normal = attach(GL_COLOR_ATTACHMENT1, GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+		//same format as the window and the offscreen target, so depth can be blitted
+		depth = attach(GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+		const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawBuffers);
+
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (!complete)
+			std::cout << "g-buffer is incomplete" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return complete;
+	}
+
+	unsigned int attach(GLenum attachment, GLint internalFormat, GLenum format, GLenum type)
+	{
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+	void setUniforms(Shader &shader, const glm::mat4 &viewProjection, const ClusteredLights &lights, const std::function<void(Shader&)> &lightUniforms)
+	{
+		shader.use();
+		lightUniforms(shader);
+		lights.setUniforms(shader);
+		shader.setInt("gAlbedoSpecular", 0);
+		shader.setInt("gNormal", 1);
+		shader.setInt("gDepth", 2);
+		shader.setMat4("viewProjection", viewProjection);
+		shader.setMat4("inverseViewProjection", glm::inverse(viewProjection));
+	}
+
+	//unit sphere pushed out so its flat faces still enclose the sphere of radius 1
+	void createSphere()
+	{
+		const float pi = 3.14159265f;
+		float scale = 1.0f / (std::cos(pi / LIGHT_VOLUME_SLICES) * std::cos(pi / (2 * LIGHT_VOLUME_STACKS)));
+		vector<glm::vec3> vertices;
+		for (unsigned int stack = 0; stack <= LIGHT_VOLUME_STACKS; ++stack)
+		{
+			float phi = pi * stack / LIGHT_VOLUME_STACKS;
+			for (unsigned int slice = 0; slice <= LIGHT_VOLUME_SLICES; ++slice)
+			{
+				float theta = 2.0f * pi * slice / LIGHT_VOLUME_SLICES;
+				vertices.push_back(scale * glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)));
+			}
+		}
+		//counter-clockwise seen from outside
+		vector<unsigned int> indices;
+		for (unsigned int stack = 0; stack < LIGHT_VOLUME_STACKS; ++stack)
+		{
+			for (unsigned int slice = 0; slice < LIGHT_VOLUME_SLICES; ++slice)
+			{
+				unsigned int a = stack * (LIGHT_VOLUME_SLICES + 1) + slice, b = a + LIGHT_VOLUME_SLICES + 1;
+				indices.insert(indices.end(), { a, a + 1, b, a + 1, b + 1, b });
+			}
+		}
+		sphereCount = (unsigned int)indices.size();
+
+		glGenVertexArrays(1, &sphereVAO);
+		glGenBuffers(1, &sphereVBO);
+		glGenBuffers(1, &sphereEBO);
+		glBindVertexArray(sphereVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+		glEnableVertexAttribArray(0);
+		glBindVertexArray(0);
+	}
+};
\ No newline at end of file
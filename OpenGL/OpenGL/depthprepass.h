@@ -0,0 +1,127 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "shadervariants.h"
+
+#include <iostream>
+
+//sample counts are read this many frames after the passes that produced them, by then the gpu has normally caught up
+const unsigned int SAMPLE_QUERY_FRAMES = 3;
+
+/*
+*depth-only pre-pass before the forward colour pass
+*the pre-pass lays down the nearest depth with a position-only vertex stream and an empty fragment shader,
+*the colour pass then tests with GL_EQUAL and no depth writes, so the lit fragment shader runs once per pixel
+*
+*GL_SAMPLES_PASSED around both passes measures the saving: the pre-pass counts the samples that passed
+*the usual GL_LESS test, which is what the colour pass would shade without it
+*/
+class DepthPrepass
+{
+public:
+	ShaderVariants shaders{ "shader/vmodel.glsl", "shader/fdepth.glsl" };
+
+	//needs a current gl context
+	void init()
+	{
+		for (Slot &slot : slots)
+			glGenQueries(2, slot.queries);
+	}
+
+	//reads back the slot about to be reused, a slot the gpu has not finished is dropped rather than waited on
+	void beginFrame()
+	{
+		current = (current + 1) % SAMPLE_QUERY_FRAMES;
+		Slot &slot = slots[current];
+		//the colour query ends after the depth query, so its result stands for both
+		GLuint available = GL_TRUE;
+		if (slot.used[COLOR])
+			glGetQueryObjectuiv(slot.queries[COLOR], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			++dropped;
+		else if (slot.used[COLOR])
+		{
+			GLuint64 depthSamples = 0, colorSamples = 0;
+			if (slot.used[DEPTH])
+				glGetQueryObjectui64v(slot.queries[DEPTH], GL_QUERY_RESULT, &depthSamples);
+			glGetQueryObjectui64v(slot.queries[COLOR], GL_QUERY_RESULT, &colorSamples);
+			if (slot.used[DEPTH])
+			{
+				totalDepthSamples += depthSamples;
+				++prepassFrames;
+			}
+			totalColorSamples += colorSamples;
+			++frames;
+		}
+		slot.used[DEPTH] = slot.used[COLOR] = false;
+	}
+
+	void beginDepth()
+	{
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glBeginQuery(GL_SAMPLES_PASSED, slots[current].queries[DEPTH]);
+	}
+
+	void endDepth()
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		slots[current].used[DEPTH] = true;
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	}
+
+	//prepassDone switches to the GL_EQUAL test
+	void beginColor(bool prepassDone)
+	{
+		if (prepassDone)
+		{
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+		}
+		glBeginQuery(GL_SAMPLES_PASSED, slots[current].queries[COLOR]);
+	}
+
+	void endColor()
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		slots[current].used[COLOR] = true;
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
+
+	//averages per frame since the last report, pixels is the size of the render target
+	void report(std::ostream &out, unsigned int pixels)
+	{
+		if (frames == 0)
+			return;
+		double color = (double)totalColorSamples / frames;
+		out << "depth: colour pass shaded " << (unsigned long long)color << " samples per frame ("
+			<< color / pixels << "x the pixels)";
+		//the averages only compare when every frame ran the pre-pass
+		if (prepassFrames == frames)
+		{
+			double depth = (double)totalDepthSamples / prepassFrames;
+			out << ", pre-pass " << (unsigned long long)depth << ", " << (depth > 0.0 ? 100.0 * (1.0 - color / depth) : 0.0)
+				<< "% of the fragment shader invocations saved";
+		}
+		if (dropped)
+			out << " (" << dropped << " frames still pending, dropped)";
+		out << std::endl;
+		totalColorSamples = totalDepthSamples = 0;
+		frames = prepassFrames = dropped = 0;
+	}
+
+private:
+	enum Pass { DEPTH, COLOR };
+
+	struct Slot {
+		unsigned int queries[2];
+		bool used[2] = { false, false };
+	};
+
+	Slot slots[SAMPLE_QUERY_FRAMES];
+	unsigned int current = 0;
+	unsigned long long totalDepthSamples = 0, totalColorSamples = 0;
+	unsigned int frames = 0, prepassFrames = 0;
+	unsigned int dropped = 0;	//frames whose sample counts were still pending
+};
\ No newline at end of file
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+
+//frames the cpu may queue ahead of the gpu, more only adds latency once the gpu is the bottleneck
+const unsigned int MAX_FRAMES_IN_FLIGHT = 4;
+
+enum SwapMode {
+	SWAP_IMMEDIATE,	//no vsync, may tear
+	SWAP_VSYNC,
+	SWAP_ADAPTIVE,	//vsync, but late frames are shown right away instead of waiting a whole interval
+};
+
+inline const char* swapModeName(SwapMode mode)
+{
+	return mode == SWAP_IMMEDIATE ? "immediate" : mode == SWAP_VSYNC ? "vsync" : "adaptive vsync";
+}
+
+//"off", "on" or "adaptive", vsync for anything else
+inline SwapMode parseSwapMode(const std::string &name)
+{
+	return name == "off" ? SWAP_IMMEDIATE : name == "adaptive" ? SWAP_ADAPTIVE : SWAP_VSYNC;
+}
+
+/*
+*paces the windowed loop: swap interval, double precision frame time and a limit on the frames in flight
+*glfwGetTimerValue counts raw ticks, float seconds from glfwGetTime lose milliseconds after a few hours
+*a fence after every swap lets beginFrame wait until the gpu finished the frame framesInFlight ago,
+*so the driver queue cannot grow and input is sampled as late as the gpu allows
+*/
+class FrameScheduler
+{
+public:
+	double time = 0.0;	//seconds since init
+	double delta = 0.0;	//seconds since the previous frame
+
+	//needs a current context
+	void init(GLFWwindow *_window, SwapMode mode, unsigned int _framesInFlight)
+	{
+		window = _window;
+		framesInFlight = std::min(std::max(_framesInFlight, 1u), MAX_FRAMES_IN_FLIGHT);
+		frequency = (double)glfwGetTimerFrequency();
+		start = glfwGetTimerValue();
+		last = start;
+		//the _tear extensions allow negative intervals
+		adaptiveSupported = glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+		setSwapMode(mode);
+	}
+
+	void setSwapMode(SwapMode mode)
+	{
+		if (mode == SWAP_ADAPTIVE && !adaptiveSupported)
+		{
+			std::cout << "adaptive vsync is not supported, using vsync" << std::endl;
+			mode = SWAP_VSYNC;
+		}
+		swapMode = mode;
+		glfwSwapInterval(mode == SWAP_IMMEDIATE ? 0 : mode == SWAP_VSYNC ? 1 : -1);
+	}
+
+	SwapMode getSwapMode() const { return swapMode; }
+	bool supportsAdaptive() const { return adaptiveSupported; }
+
+	//wait for the frame slot, then advance time
+	void beginFrame()
+	{
+		GLsync &fence = fences[frame % framesInFlight];
+		if (fence)
+		{
+			std::uint64_t before = glfwGetTimerValue();
+			GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			std::uint64_t after = glfwGetTimerValue();
+			glDeleteSync(fence);
+			fence = 0;
+			totalWait += seconds(after - before);
+			//the frame was finished by now, an upper bound when it already had been
+			if (status != GL_TIMEOUT_EXPIRED && fenceInput[frame % framesInFlight])
+			{
+				totalGpuLatency += seconds(after - fenceInput[frame % framesInFlight]);
+				++gpuLatencyFrames;
+			}
+		}
+
+		std::uint64_t now = glfwGetTimerValue();
+		time = seconds(now - start);
+		delta = seconds(now - last);
+		last = now;
+		maxDelta = std::max(maxDelta, delta);
+	}
+
+	//right after the input was polled, the start of the latency measurement
+	void inputSampled()
+	{
+		inputTime = glfwGetTimerValue();
+	}
+
+	void endFrame()
+	{
+		glfwSwapBuffers(window);
+		std::uint64_t swapped = glfwGetTimerValue();
+		fences[frame % framesInFlight] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		fenceInput[frame % framesInFlight] = inputTime;
+		if (inputTime)
+		{
+			totalSwapLatency += seconds(swapped - inputTime);
+			++swapLatencyFrames;
+		}
+		++frame;
+		++frames;
+	}
+
+	//averages since the last report
+	void report(std::ostream &out)
+	{
+		if (frames == 0)
+			return;
+		out << "pacing: " << swapModeName(swapMode) << ", " << framesInFlight << " frames in flight, max frame "
+			<< maxDelta * 1000.0 << " ms, fence wait " << totalWait * 1000.0 / frames << " ms, input to swap "
+			<< (swapLatencyFrames ? totalSwapLatency * 1000.0 / swapLatencyFrames : 0.0) << " ms, input to gpu done <= "
+			<< (gpuLatencyFrames ? totalGpuLatency * 1000.0 / gpuLatencyFrames : 0.0) << " ms" << std::endl;
+		frames = swapLatencyFrames = gpuLatencyFrames = 0;
+		totalWait = totalSwapLatency = totalGpuLatency = maxDelta = 0.0;
+	}
+
+private:
+	GLFWwindow *window = nullptr;
+	unsigned int framesInFlight = 2;
+	SwapMode swapMode = SWAP_VSYNC;
+	bool adaptiveSupported = false;
+	double frequency = 1.0;
+	std::uint64_t start = 0, last = 0, inputTime = 0;
+	GLsync fences[MAX_FRAMES_IN_FLIGHT] = {};
+	std::uint64_t fenceInput[MAX_FRAMES_IN_FLIGHT] = {};	//input time of the frame each fence ends
+	unsigned long long frame = 0;
+
+	unsigned int frames = 0, swapLatencyFrames = 0, gpuLatencyFrames = 0;
+	double totalWait = 0.0, totalSwapLatency = 0.0, totalGpuLatency = 0.0, maxDelta = 0.0;
+
+	double seconds(std::uint64_t ticks) const
+	{
+		return ticks / frequency;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+/*
+*glad is generated for the 3.3 core profile only
+*entry points of newer versions and extensions are loaded here when the driver exposes them
+*call loadGLExtensions once after gladLoadGLLoader, every flag stays false otherwise
+*/
+
+//ARB_get_program_binary, core in 4.1
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+//KHR_parallel_shader_compile, ARB_parallel_shader_compile uses the same values
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+struct GLExtensions {
+	bool programBinary = false;
+	PFNGLGETPROGRAMBINARYPROC getProgramBinary = nullptr;
+	PFNGLPROGRAMBINARYPROC programBinaryLoad = nullptr;
+	PFNGLPROGRAMPARAMETERIPROC programParameteri = nullptr;
+
+	bool parallelShaderCompile = false;
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = nullptr;
+};
+
+inline GLExtensions& glExtensions()
+{
+	static GLExtensions extensions;
+	return extensions;
+}
+
+//needs a current context
+inline void loadGLExtensions()
+{
+	GLExtensions &ext = glExtensions();
+	int major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	bool gl41 = major > 4 || (major == 4 && minor >= 1);
+
+	if (gl41 || glfwExtensionSupported("GL_ARB_get_program_binary"))
+	{
+		ext.getProgramBinary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+		ext.programBinaryLoad = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+		ext.programParameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+		//drivers may expose the extension with no binary format at all
+		int formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		ext.programBinary = ext.getProgramBinary && ext.programBinaryLoad && ext.programParameteri && formats > 0;
+	}
+
+	if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+		ext.maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+	else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+		ext.maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+	ext.parallelShaderCompile = ext.maxShaderCompilerThreads != nullptr;
+	//let the driver pick the number of compiler threads
+	if (ext.parallelShaderCompile)
+		ext.maxShaderCompilerThreads(0xFFFFFFFFu);
+}
\ No newline at end of file
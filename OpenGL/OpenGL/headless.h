@@ -0,0 +1,221 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "camera.h"
+#include "png.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+
+using std::vector;
+using std::string;
+
+/*
+*command line of the headless mode:
+*--headless [--frames N] [--png DIR] [--png-every N] [--timings FILE] [--trace FILE] [--clustered] [--deferred] [--prepass] [--cull] [--no-shadows]
+*[--particles N] [--sorted-particles] [--opaque]
+*and of the window only:
+*[--vsync off|on|adaptive] [--frames-in-flight N] [--on-demand] [--views N]
+*/
+struct HeadlessOptions {
+	bool enabled = false;
+	unsigned int frames = 600;
+	string pngDirectory;			//empty disables frame dumps
+	unsigned int pngEvery = 60;		//dump every nth frame
+	string timingsPath = "timings.csv";
+	string tracePath = "trace.json";	//chrome trace of the whole run, empty disables it
+	bool clustered = false;			//clustered lighting with the stress lights
+	bool deferred = false;			//deferred shading of the stress lights
+	bool prepass = false;			//depth pre-pass before the forward colour pass
+	bool cull = false;				//hi-z occlusion culling
+	bool shadows = true;			//cascaded shadow maps of the directional light
+	unsigned int particles = 0;		//gpu particles, 0 disables them
+	bool sortedParticles = false;	//alpha blended back to front instead of additive
+	bool transparency = true;		//transparent materials in their own pass, off draws them opaque
+	string vsync = "on";
+	unsigned int framesInFlight = 2;
+	bool onDemand = false;			//only draw when something changed
+	unsigned int views = 1;			//split screen views, up to MAX_VIEWS
+};
+
+inline HeadlessOptions parseHeadlessOptions(int argc, char **argv)
+{
+	HeadlessOptions options;
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--headless")
+			options.enabled = true;
+		else if (arg == "--frames" && hasValue)
+			options.frames = (unsigned int)std::atoi(argv[++i]);
+		else if (arg == "--png" && hasValue)
+			options.pngDirectory = argv[++i];
+		else if (arg == "--png-every" && hasValue)
+			options.pngEvery = std::max(std::atoi(argv[++i]), 1);
+		else if (arg == "--timings" && hasValue)
+			options.timingsPath = argv[++i];
+		else if (arg == "--trace" && hasValue)
+			options.tracePath = argv[++i];
+		else if (arg == "--clustered")
+			options.clustered = true;
+		else if (arg == "--deferred")
+			options.deferred = true;
+		else if (arg == "--prepass")
+			options.prepass = true;
+		else if (arg == "--cull")
+			options.cull = true;
+		else if (arg == "--no-shadows")
+			options.shadows = false;
+		else if (arg == "--particles" && hasValue)
+			options.particles = (unsigned int)std::max(std::atoi(argv[++i]), 0);
+		else if (arg == "--sorted-particles")
+			options.sortedParticles = true;
+		else if (arg == "--opaque")
+			options.transparency = false;
+		else if (arg == "--vsync" && hasValue)
+			options.vsync = argv[++i];
+		else if (arg == "--frames-in-flight" && hasValue)
+			options.framesInFlight = (unsigned int)std::max(std::atoi(argv[++i]), 1);
+		else if (arg == "--on-demand")
+			options.onDemand = true;
+		else if (arg == "--views" && hasValue)
+			options.views = (unsigned int)std::max(std::atoi(argv[++i]), 1);
+		else
+			std::cout << "unknown argument " << arg << std::endl;
+	}
+	return options;
+}
+
+//framebuffer object with a color and a depth renderbuffer, used instead of the window surface
+class OffscreenTarget
+{
+public:
+	unsigned int FBO = 0;
+	unsigned int width = 0, height = 0;
+
+	bool create(unsigned int _width, unsigned int _height)
+	{
+		width = _width;
+		height = _height;
+
+		glGenFramebuffers(1, &FBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+		glGenRenderbuffers(1, &colorRBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+
+		glGenRenderbuffers(1, &depthRBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (!complete)
+			std::cout << "offscreen framebuffer is incomplete" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return complete;
+	}
+
+	void bind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glViewport(0, 0, width, height);
+	}
+
+	void readPixels(vector<unsigned char> &rgba)
+	{
+		rgba.resize((size_t)width * height * 4);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	}
+
+private:
+	unsigned int colorRBO = 0, depthRBO = 0;
+};
+
+//deterministic orbit around a target, one revolution every period seconds
+struct CameraPath {
+	glm::vec3 target = glm::vec3(0.0f, -0.5f, 0.0f);
+	float radius = 3.0f;
+	float height = 0.5f;
+	float period = 10.0f;
+	//the orbit also dollies in and out by this fraction of the radius
+	float dolly = 0.4f;
+
+	void apply(Camera &camera, float time) const
+	{
+		float angle = glm::two_pi<float>() * time / period;
+		float distance = radius * (1.0f + dolly * glm::sin(angle * 2.0f));
+		camera.position = target + glm::vec3(glm::sin(angle) * distance, height, glm::cos(angle) * distance);
+		camera.lookAt(target);
+	}
+};
+
+//per-frame times in milliseconds with percentile summaries
+class FrameTimings
+{
+public:
+	vector<double> frames;
+
+	void add(double ms)
+	{
+		frames.push_back(ms);
+	}
+
+	//nearest rank percentile, p in [0, 100]
+	double percentile(double p) const
+	{
+		if (frames.empty())
+			return 0.0;
+		vector<double> sorted(frames);
+		std::sort(sorted.begin(), sorted.end());
+		size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+		return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+	}
+
+	double mean() const
+	{
+		double total = 0.0;
+		for (double ms : frames)
+			total += ms;
+		return frames.empty() ? 0.0 : total / frames.size();
+	}
+
+	void report(std::ostream &out) const
+	{
+		out << frames.size() << " frames, mean " << mean() << " ms, p50 " << percentile(50.0)
+			<< " ms, p95 " << percentile(95.0) << " ms, p99 " << percentile(99.0)
+			<< " ms, max " << percentile(100.0) << " ms" << std::endl;
+	}
+
+	bool writeCsv(const string &path) const
+	{
+		std::ofstream file(path, std::ios::trunc);
+		if (!file)
+			return false;
+		file << "frame,ms\n";
+		for (size_t i = 0; i < frames.size(); ++i)
+			file << i << "," << frames[i] << "\n";
+		return (bool)file;
+	}
+};
+
+inline string framePath(const string &directory, unsigned int frame)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "frame_%05u.png", frame);
+	return directory + "/" + name;
+}
\ No newline at end of file
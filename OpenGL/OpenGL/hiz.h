@@ -0,0 +1,295 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "renderstats.h"
+#include "shaderlibrary.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+using std::vector;
+
+//transform feedback results are read back this many frames after the test, a fence that is still unsignaled then is not waited on
+const unsigned int HIZ_FRAMES = 3;
+//results tested against an older pyramid are dropped, the pyramid and the read back are HIZ_FRAMES + 1 apart normally
+const unsigned int HIZ_MAX_AGE = HIZ_FRAMES + 2;
+
+struct HiZStats {
+	unsigned int tested = 0;	//bounding spheres of the frame the results came from
+	unsigned int culled = 0;
+	unsigned int pending = 0;	//tests dropped unfinished, their frames kept the older visibility, reset by the caller
+};
+
+/*
+*hierarchical-z occlusion culling
+*after the opaque pass the depth buffer is copied and reduced into a pyramid of farthest depths,
+*the next frame tests the bounding sphere of every draw against it and skips the hidden ones
+*
+*gl 3.3 has neither compute shaders nor indirect draws: the test is a vertex shader over one point
+*per sphere with rasterization discarded, its results are captured with transform feedback
+*and read back HIZ_FRAMES later behind a fence, the draw list is then compacted on the cpu
+*a draw that becomes visible can therefore appear a few frames late, later still when the gpu falls behind
+*/
+class HiZCulling
+{
+public:
+	HiZStats stats;
+
+	//width and height of the render target whose depth is reduced, the programs are added to shaders
+	void create(unsigned int _width, unsigned int _height, ShaderLibrary &shaders)
+	{
+		glGenFramebuffers(1, &copyFBO);
+		glGenFramebuffers(1, &pyramidFBO);
+		allocate(_width, _height);
+
+		reduceShader = &shaders.add("hi-z reduce", "shader/vdeferred.glsl", "shader/fhiz.glsl");
+		testShader = &shaders.add("hi-z test", "shader/vhiztest.glsl", "shader/fdepth.glsl", {}, { "Visible" });
+		glGenVertexArrays(1, &emptyVAO);
+
+		glGenVertexArrays(1, &sphereVAO);
+		glGenBuffers(1, &sphereVBO);
+		glBindVertexArray(sphereVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+		glEnableVertexAttribArray(0);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		for (Slot &slot : slots)
+			glGenBuffers(1, &slot.results);
+	}
+
+	//new depth copy and pyramid for a render target of another size, the old pyramid is dropped
+	void resize(unsigned int _width, unsigned int _height)
+	{
+		const unsigned int textures[2] = { depthCopy, pyramid };
+		glDeleteTextures(2, textures);
+		allocate(_width, _height);
+		hasPyramid = false;
+	}
+
+	//forget the pyramid and the pending tests, e.g. while culling is off, so it restarts from fresh depth
+	void invalidate()
+	{
+		hasPyramid = false;
+		for (Slot &slot : slots)
+		{
+			if (slot.fence)
+				glDeleteSync(slot.fence);
+			slot.fence = 0;
+		}
+		visible.clear();
+		stats = HiZStats();
+	}
+
+	/*
+	*visibility of the spheres tested HIZ_FRAMES ago, one entry per sphere of test, called once per frame
+	*a test the gpu has not finished yet is dropped and the last visibility is kept
+	*everything is visible until results arrive, when the number of spheres changed or when the pyramid was too old
+	*/
+	const vector<unsigned char>& collect(size_t count)
+	{
+		++frame;
+		Slot &slot = slots[current];
+		if (slot.fence && frame - slot.pyramidFrame > HIZ_MAX_AGE)
+		{
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+		}
+		//the slot is reused by test this frame, so an unsignaled fence is dropped instead of waited on
+		if (slot.fence && glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			++stats.pending;
+		}
+		if (slot.fence)
+		{
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			results.resize(slot.count);
+			glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, slot.results);
+			glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, slot.count * sizeof(unsigned int), results.data());
+			glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+
+			if (slot.count == count)
+			{
+				visible.resize(count);
+				stats.tested = slot.count;
+				stats.culled = 0;
+				for (size_t i = 0; i < count; ++i)
+				{
+					visible[i] = results[i] != 0;
+					stats.culled += !visible[i];
+				}
+				return visible;
+			}
+		}
+		if (visible.size() != count)
+		{
+			visible.assign(count, 1);
+			stats = HiZStats();
+		}
+		return visible;
+	}
+
+	//test world space spheres (center, radius) against the pyramid of the last reduce
+	void test(const vector<glm::vec4> &spheres)
+	{
+		Slot &slot = slots[current];
+		current = (current + 1) % HIZ_FRAMES;
+		if (!hasPyramid || spheres.empty())
+			return;
+
+		glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+		glBufferData(GL_ARRAY_BUFFER, spheres.size() * sizeof(glm::vec4), spheres.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (slot.capacity < spheres.size())
+		{
+			slot.capacity = (unsigned int)spheres.size();
+			glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, slot.results);
+			glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, slot.capacity * sizeof(unsigned int), NULL, GL_STREAM_READ);
+			glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+		}
+		slot.count = (unsigned int)spheres.size();
+		slot.pyramidFrame = pyramidFrame;
+
+		testShader->use();
+		testShader->setMat4("viewProjection", pyramidViewProjection);
+		testShader->setInt("pyramid", 0);
+		testShader->setInt("pyramidLevels", levels);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, slot.results);
+		glBindVertexArray(sphereVAO);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, slot.count);
+		glEndTransformFeedback();
+		glBindVertexArray(0);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glDisable(GL_RASTERIZER_DISCARD);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		++renderStats().drawCalls;
+	}
+
+	//reduce the depth of the bound draw framebuffer, rendered with viewProjection
+	void reduce(const glm::mat4 &viewProjection)
+	{
+		GLint bound = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, bound);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copyFBO);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, pyramidFBO);
+		glDisable(GL_DEPTH_TEST);
+		reduceShader->use();
+		reduceShader->setInt("source", 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindVertexArray(emptyVAO);
+		for (unsigned int level = 0; level < levels; ++level)
+		{
+			//sampling only the previous level while rendering the next one is no feedback loop
+			if (level == 0)
+				glBindTexture(GL_TEXTURE_2D, depthCopy);
+			else
+			{
+				glBindTexture(GL_TEXTURE_2D, pyramid);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+			}
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, level);
+			glViewport(0, 0, std::max(pyramidWidth >> level, 1u), std::max(pyramidHeight >> level, 1u));
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		}
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindVertexArray(0);
+
+		RenderStats &stats = renderStats();
+		stats.drawCalls += levels;
+		stats.vertexArrayBinds += 1;
+
+		glEnable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, bound);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		pyramidViewProjection = viewProjection;
+		pyramidFrame = frame;
+		hasPyramid = true;
+	}
+
+private:
+	struct Slot {
+		unsigned int results = 0;	//one uint per sphere
+		unsigned int capacity = 0;
+		unsigned int count = 0;
+		unsigned long long pyramidFrame = 0;	//when the pyramid tested against was reduced
+		GLsync fence = 0;
+	};
+
+	unsigned int width = 0, height = 0;
+	unsigned int depthCopy = 0, copyFBO = 0;
+	unsigned int pyramid = 0, pyramidFBO = 0;
+	unsigned int pyramidWidth = 0, pyramidHeight = 0, levels = 0;
+	glm::mat4 pyramidViewProjection;
+	bool hasPyramid = false;
+	unsigned long long frame = 0, pyramidFrame = 0;	//counted by collect
+	Shader *reduceShader = nullptr, *testShader = nullptr;
+	unsigned int emptyVAO = 0, sphereVAO = 0, sphereVBO = 0;
+	Slot slots[HIZ_FRAMES];
+	unsigned int current = 0;
+	vector<unsigned int> results;
+	vector<unsigned char> visible;
+
+	void allocate(unsigned int _width, unsigned int _height)
+	{
+		width = _width;
+		height = _height;
+
+		//same format as the render targets so their depth can be blitted
+		glGenTextures(1, &depthCopy);
+		glBindTexture(GL_TEXTURE_2D, depthCopy);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+		setNearest();
+		glBindFramebuffer(GL_FRAMEBUFFER, copyFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthCopy, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+
+		//level 0 is half the target, every level halves again down to 1x1
+		pyramidWidth = std::max(width / 2, 1u);
+		pyramidHeight = std::max(height / 2, 1u);
+		levels = 1;
+		while ((std::max(pyramidWidth, pyramidHeight) >> levels) > 0)
+			++levels;
+		glGenTextures(1, &pyramid);
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+		for (unsigned int level = 0; level < levels; ++level)
+			glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(pyramidWidth >> level, 1u), std::max(pyramidHeight >> level, 1u), 0, GL_RED, GL_FLOAT, NULL);
+		setNearest();
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	static void setNearest()
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+};
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+using std::vector;
+
+/*
+*fixed pool of worker threads running data parallel loops
+*the calling thread works on the loop as well, so worker 0 is always the caller
+*/
+class JobSystem
+{
+public:
+	//func(begin, end, worker) is called for consecutive ranges of at most grain items
+	typedef std::function<void(size_t, size_t, unsigned int)> RangeFunc;
+
+	//0 uses every hardware thread
+	explicit JobSystem(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		for (unsigned int i = 1; i < threadCount; ++i)
+			threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (std::thread &thread : threads)
+			thread.join();
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	unsigned int workerCount() const
+	{
+		return (unsigned int)threads.size() + 1;
+	}
+
+	//returns when every item has been processed
+	void parallelFor(size_t count, size_t grain, const RangeFunc &func)
+	{
+		if (count == 0)
+			return;
+		grain = std::max(grain, (size_t)1);
+		if (threads.empty() || count <= grain)
+		{
+			func(0, count, 0);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &func;
+			jobCount = count;
+			jobGrain = grain;
+			next = 0;
+			busy = (unsigned int)threads.size();
+			++generation;
+		}
+		wake.notify_all();
+
+		runChunks(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return busy == 0; });
+		job = nullptr;
+	}
+
+private:
+	vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	const RangeFunc *job = nullptr;
+	size_t jobCount = 0, jobGrain = 1;
+	std::atomic<size_t> next{ 0 };
+	unsigned int generation = 0;
+	unsigned int busy = 0;
+	bool quit = false;
+
+	void runChunks(unsigned int worker)
+	{
+		for (;;)
+		{
+			size_t begin = next.fetch_add(jobGrain);
+			if (begin >= jobCount)
+				break;
+			(*job)(begin, std::min(begin + jobGrain, jobCount), worker);
+		}
+	}
+
+	void workerLoop(unsigned int worker)
+	{
+		unsigned int seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return quit || generation != seen; });
+				if (quit)
+					return;
+				seen = generation;
+			}
+
+			runChunks(worker);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--busy == 0)
+				done.notify_one();
+		}
+	}
+};
\ No newline at end of file
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+
+using std::vector;
+using std::string;
+
+//each lod keeps about this fraction of the triangles of the previous one
+const float LOD_REDUCTION = 0.5f;
+const size_t LOD_MAX_LEVELS = 4;
+const size_t LOD_MIN_TRIANGLES = 64;
+//weight of the planes that keep open borders (and uv seams) in place
+const double LOD_BORDER_WEIGHT = 10.0;
+
+//symmetric 4x4 matrix of the plane equations, only the upper triangle is stored
+struct Quadric {
+	double a[10] = { 0.0 };
+
+	void addPlane(const glm::dvec3 &n, double d, double weight = 1.0)
+	{
+		a[0] += weight * n.x * n.x; a[1] += weight * n.x * n.y; a[2] += weight * n.x * n.z; a[3] += weight * n.x * d;
+		a[4] += weight * n.y * n.y; a[5] += weight * n.y * n.z; a[6] += weight * n.y * d;
+		a[7] += weight * n.z * n.z; a[8] += weight * n.z * d;
+		a[9] += weight * d * d;
+	}
+
+	Quadric& operator+=(const Quadric &other)
+	{
+		for (int i = 0; i < 10; ++i)
+			a[i] += other.a[i];
+		return *this;
+	}
+
+	//sum of squared distances from p to all accumulated planes
+	double evaluate(const glm::vec3 &p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double result = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+			+ a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+			+ a[7] * z * z + 2 * a[8] * z
+			+ a[9];
+		return result > 0.0 ? result : 0.0;
+	}
+};
+
+/*
+*quadric error edge collapse (garland & heckbert) restricted to collapsing a vertex onto one
+*of its neighbours, so the simplified index buffer still refers to the original vertex buffer
+*error receives the largest distance error (in model units) introduced by a collapse
+*/
+inline vector<unsigned int> simplifyMesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices,
+	size_t targetIndexCount, float &error)
+{
+	struct Collapse {
+		double cost;
+		unsigned int from, to;
+		unsigned int fromVersion, toVersion;
+		bool operator<(const Collapse &other) const { return cost > other.cost; }
+	};
+
+	size_t vertexCount = vertices.size();
+	size_t triangleCount = indices.size() / 3;
+
+	vector<unsigned int> triangles(indices.begin(), indices.begin() + triangleCount * 3);
+	vector<bool> removed(triangleCount, false);
+	vector<vector<unsigned int>> vertexTriangles(vertexCount);
+	vector<Quadric> quadrics(vertexCount);
+	vector<unsigned int> versions(vertexCount, 0);
+	vector<unsigned int> collapsed(vertexCount);
+	std::iota(collapsed.begin(), collapsed.end(), 0);
+
+	auto position = [&](unsigned int v) -> const glm::vec3& { return vertices[v].position; };
+	auto edgeKey = [](unsigned int a, unsigned int b) -> uint64_t {
+		if (a > b)
+			std::swap(a, b);
+		return (uint64_t(a) << 32) | b;
+	};
+
+	std::unordered_map<uint64_t, unsigned int> edgeCount;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		unsigned int *tri = &triangles[t * 3];
+		glm::dvec3 p0(position(tri[0])), p1(position(tri[1])), p2(position(tri[2]));
+		glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(n);
+		if (length > 0.0)
+		{
+			n /= length;
+			double d = -glm::dot(n, p0);
+			for (int k = 0; k < 3; ++k)
+				quadrics[tri[k]].addPlane(n, d);
+		}
+		for (int k = 0; k < 3; ++k)
+		{
+			vertexTriangles[tri[k]].push_back(t);
+			++edgeCount[edgeKey(tri[k], tri[(k + 1) % 3])];
+		}
+	}
+
+	//edges used by a single triangle are borders: add planes perpendicular to the face through them
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		unsigned int *tri = &triangles[t * 3];
+		glm::dvec3 p0(position(tri[0])), p1(position(tri[1])), p2(position(tri[2]));
+		glm::dvec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+		for (int k = 0; k < 3; ++k)
+		{
+			unsigned int a = tri[k], b = tri[(k + 1) % 3];
+			if (edgeCount[edgeKey(a, b)] != 1)
+				continue;
+			glm::dvec3 pa(position(a)), pb(position(b));
+			glm::dvec3 n = glm::cross(pb - pa, faceNormal);
+			double length = glm::length(n);
+			if (length <= 0.0)
+				continue;
+			n /= length;
+			double d = -glm::dot(n, pa);
+			quadrics[a].addPlane(n, d, LOD_BORDER_WEIGHT);
+			quadrics[b].addPlane(n, d, LOD_BORDER_WEIGHT);
+		}
+	}
+
+	std::priority_queue<Collapse> heap;
+	auto pushEdge = [&](unsigned int a, unsigned int b) {
+		Quadric q = quadrics[a];
+		q += quadrics[b];
+		double costAB = q.evaluate(position(b));
+		double costBA = q.evaluate(position(a));
+		if (costAB <= costBA)
+			heap.push({ costAB, a, b, versions[a], versions[b] });
+		else
+			heap.push({ costBA, b, a, versions[b], versions[a] });
+	};
+
+	for (size_t t = 0; t < triangleCount; ++t)
+		for (int k = 0; k < 3; ++k)
+		{
+			unsigned int a = triangles[t * 3 + k], b = triangles[t * 3 + (k + 1) % 3];
+			if (a < b)
+				pushEdge(a, b);
+		}
+
+	//moving from onto to must not turn any remaining triangle of from upside down
+	auto flips = [&](unsigned int from, unsigned int to) -> bool {
+		for (unsigned int t : vertexTriangles[from])
+		{
+			if (removed[t])
+				continue;
+			unsigned int *tri = &triangles[t * 3];
+			if (tri[0] == to || tri[1] == to || tri[2] == to)
+				continue;
+			glm::vec3 before[3], after[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				before[k] = position(tri[k]);
+				after[k] = tri[k] == from ? position(to) : before[k];
+			}
+			glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(n0, n1) <= 0.0f)
+				return true;
+		}
+		return false;
+	};
+
+	size_t liveTriangles = triangleCount;
+	size_t targetTriangles = targetIndexCount / 3;
+	double maxCost = 0.0;
+
+	while (liveTriangles > targetTriangles && !heap.empty())
+	{
+		Collapse c = heap.top();
+		heap.pop();
+
+		if (collapsed[c.from] != c.from || collapsed[c.to] != c.to)
+			continue;
+		if (versions[c.from] != c.fromVersion || versions[c.to] != c.toVersion)
+			continue;
+		if (flips(c.from, c.to))
+			continue;
+
+		collapsed[c.from] = c.to;
+		quadrics[c.to] += quadrics[c.from];
+		++versions[c.from];
+		++versions[c.to];
+		maxCost = std::max(maxCost, c.cost);
+
+		for (unsigned int t : vertexTriangles[c.from])
+		{
+			if (removed[t])
+				continue;
+			unsigned int *tri = &triangles[t * 3];
+			for (int k = 0; k < 3; ++k)
+				if (tri[k] == c.from)
+					tri[k] = c.to;
+			if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+			{
+				removed[t] = true;
+				--liveTriangles;
+			}
+			else
+				vertexTriangles[c.to].push_back(t);
+		}
+		vertexTriangles[c.from].clear();
+
+		//drop dead triangles and requeue the edges around the merged vertex
+		vector<unsigned int> &around = vertexTriangles[c.to];
+		around.erase(std::remove_if(around.begin(), around.end(),
+			[&](unsigned int t) { return removed[t]; }), around.end());
+		for (unsigned int t : around)
+			for (int k = 0; k < 3; ++k)
+			{
+				unsigned int w = triangles[t * 3 + k];
+				if (w != c.to)
+					pushEdge(c.to, w);
+			}
+	}
+
+	vector<unsigned int> result;
+	result.reserve(liveTriangles * 3);
+	for (size_t t = 0; t < triangleCount; ++t)
+		if (!removed[t])
+			result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+
+	error = (float)std::sqrt(maxCost);
+	return result;
+}
+
+//build the lod chain, level 0 is the untouched index buffer
+inline vector<LodLevel> generateLods(const vector<Vertex> &vertices, const vector<unsigned int> &indices)
+{
+	vector<LodLevel> levels;
+	levels.push_back({ indices, 0.0f });
+
+	while (levels.size() < LOD_MAX_LEVELS)
+	{
+		const LodLevel &previous = levels.back();
+		size_t previousTriangles = previous.indices.size() / 3;
+		if (previousTriangles < LOD_MIN_TRIANGLES * 2)
+			break;
+
+		size_t target = (size_t)(previousTriangles * LOD_REDUCTION) * 3;
+		LodLevel level;
+		level.indices = simplifyMesh(vertices, previous.indices, target, level.error);
+		//error is measured against the previous level, accumulate it to stay conservative against level 0
+		level.error += previous.error;
+
+		//stop when the simplifier got stuck (flips or borders everywhere)
+		if (level.indices.size() > previous.indices.size() * 0.9f)
+			break;
+		levels.push_back(std::move(level));
+	}
+	return levels;
+}
+
+//simplified levels of one mesh as stored next to the model file
+struct LodCacheEntry {
+	unsigned int vertexCount = 0;
+	vector<LodLevel> levels;
+};
+
+/*
+*lod cache layout (native endianness):
+*"LOD1", mesh count, then per mesh: vertex count, level count, per level: error, index count, indices
+*/
+const uint32_t LOD_CACHE_MAGIC = 0x31444f4c;
+
+inline bool loadLodCache(const string &path, vector<LodCacheEntry> &entries)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	uint32_t magic = 0, meshCount = 0;
+	file.read((char*)&magic, sizeof(magic));
+	file.read((char*)&meshCount, sizeof(meshCount));
+	if (!file || magic != LOD_CACHE_MAGIC)
+		return false;
+
+	entries.assign(meshCount, LodCacheEntry());
+	for (LodCacheEntry &entry : entries)
+	{
+		uint32_t vertexCount = 0, levelCount = 0;
+		file.read((char*)&vertexCount, sizeof(vertexCount));
+		file.read((char*)&levelCount, sizeof(levelCount));
+		if (!file || levelCount > LOD_MAX_LEVELS)
+			return false;
+		entry.vertexCount = vertexCount;
+		entry.levels.resize(levelCount);
+		for (LodLevel &level : entry.levels)
+		{
+			uint32_t indexCount = 0;
+			file.read((char*)&level.error, sizeof(level.error));
+			file.read((char*)&indexCount, sizeof(indexCount));
+			if (!file)
+				return false;
+			level.indices.resize(indexCount);
+			file.read((char*)level.indices.data(), indexCount * sizeof(unsigned int));
+			if (!file)
+				return false;
+			for (unsigned int index : level.indices)
+				if (index >= vertexCount)
+					return false;
+		}
+	}
+	return true;
+}
+
+inline bool saveLodCache(const string &path, const vector<LodCacheEntry> &entries)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	uint32_t meshCount = (uint32_t)entries.size();
+	file.write((const char*)&LOD_CACHE_MAGIC, sizeof(LOD_CACHE_MAGIC));
+	file.write((const char*)&meshCount, sizeof(meshCount));
+	for (const LodCacheEntry &entry : entries)
+	{
+		uint32_t vertexCount = entry.vertexCount;
+		uint32_t levelCount = (uint32_t)entry.levels.size();
+		file.write((const char*)&vertexCount, sizeof(vertexCount));
+		file.write((const char*)&levelCount, sizeof(levelCount));
+		for (const LodLevel &level : entry.levels)
+		{
+			uint32_t indexCount = (uint32_t)level.indices.size();
+			file.write((const char*)&level.error, sizeof(level.error));
+			file.write((const char*)&indexCount, sizeof(indexCount));
+			file.write((const char*)level.indices.data(), indexCount * sizeof(unsigned int));
+		}
+	}
+	return (bool)file;
+}
\ No newline at end of file
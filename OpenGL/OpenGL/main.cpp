@@ -7,22 +7,53 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "scene.h"
+#include "skinning.h"
+#include "pose.h"
+#include "jobs.h"
+#include "headless.h"
+#include "profiler.h"
+#include "glext.h"
+#include "shaderlibrary.h"
+#include "shadervariants.h"
+#include "shaderreload.h"
+#include "clusters.h"
+#include "deferred.h"
+#include "depthprepass.h"
+#include "hiz.h"
+#include "shadows.h"
+#include "framepacing.h"
+#include "simulation.h"
+#include "ondemand.h"
+#include "views.h"
+#include "particles.h"
+#include "oit.h"
 
 #include <iostream>
 #include <algorithm>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xPos, double yPos);
 void scroll_callback(GLFWwindow* window, double xOffset, double yOffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void refresh_callback(GLFWwindow* window);
+void setViews(unsigned int count);
 void processInput(GLFWwindow* window);
+void setLightUniforms(Shader &shader);
+void updateClusterLights(ClusteredLights &clusters, const vector<glm::vec4> &stressLights, float time);
 
 unsigned int loadTexture(char const * path);
 
 const unsigned int WIDTH = 800;
 const unsigned int HEIGHT = 600;
+//size of the default framebuffer, follows the window, the full screen targets are resized to it
+int framebufferWidth = WIDTH;
+int framebufferHeight = HEIGHT;
 
 float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+//seconds, double so long sessions keep their precision
+double lastFrame = 0.0;
 
 bool firstMouse = true;
 float lastX = WIDTH / 2;
@@ -30,12 +61,71 @@ float lastY = HEIGHT / 2;
 
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f), false);
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+glm::vec3 lightDirection(-0.2f, -1.0f, -0.3f);
 
 bool showMatrix = false;
 float lastChange = 0.0f;
 
-int main()
+//pick mesh lods from their projected error, toggled with L
+bool useLod = true;
+const float LOD_PIXEL_ERROR = 1.0f;
+
+//cpu and gpu scopes of every frame, P starts and stops a trace capture
+Profiler profiler;
+const char *TRACE_PATH = "trace.json";
+
+//swap interval, frame time and frames in flight of the windowed loop, V cycles the swap modes
+FrameScheduler scheduler;
+//input and camera of the windowed loop on a fixed timestep thread, the render thread interpolates its states
+Simulation simulation;
+//only draw when something changed, toggled with R
+RenderOnDemand onDemand;
+//crowd and stress light animation, toggled with K, a paused scene lets the on-demand mode idle
+bool animate = true;
+double animationTime = 0.0;
+
+//stats are printed every REPORT_INTERVAL seconds
+const float REPORT_INTERVAL = 2.0f;
+double lastReport = 0.0;
+
+//skinned crowd benchmark, 0 skips loading the horse
+const unsigned int SKINNED_INSTANCES = 64;
+const float SKINNED_SCALE = 0.01f;
+
+//lit shaders are specialized for this many point lights
+const unsigned int POINT_LIGHTS = 1;
+
+//clustered lighting of the stress lights instead of the uniform lights, toggled with C
+bool useClusters = false;
+//deferred shading of the same lights, toggled with F, takes precedence over useClusters
+bool useDeferred = false;
+//depth-only pass before the forward colour pass, toggled with Z
+bool useDepthPrepass = false;
+//hi-z occlusion culling of the scene meshes and the crowd, toggled with O
+bool useOcclusionCulling = false;
+//bind pose bounds of the horse grown to hold its animated poses
+const float HORSE_BOUNDS_INFLATE = 1.5f;
+//cascaded shadows of the directional light in every path, toggled with H
+bool useShadows = true;
+//split screen views sharing the scene and its resources, M cycles their number
+MultiView multiView;
+//gpu particles from the light cube, --particles N, B switches between additive and sorted alpha blending
+ParticleSystem particles;
+//weighted blended transparency of glass materials, toggled with T, off draws them opaque like the rest
+bool useTransparency = true;
+//opacity the suit's glass material is drawn with
+const float SUIT_GLASS_OPACITY = 0.35f;
+const unsigned int STRESS_LIGHTS = 1024;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+
+//fixed step of the headless mode so every run renders the same frames
+const float HEADLESS_DELTA_TIME = 1.0f / 60.0f;
+
+int main(int argc, char **argv)
 {
+	HeadlessOptions headless = parseHeadlessOptions(argc, argv);
+
 	//init glfw
 	glfwInit();
 
@@ -51,8 +141,26 @@ int main()
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+	/*
+	*headless runs use an invisible window with an osmesa (software) context
+	*glfw built with GLFW_USE_OSMESA uses its null platform and needs no display at all
+	*/
+	GLFWwindow* window = NULL;
+	if (headless.enabled)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		window = glfwCreateWindow(WIDTH, HEIGHT, "OpenGL", NULL, NULL);
+		if (!window)
+		{
+			std::cout << "osmesa context unavailable, falling back to a hidden native window" << std::endl;
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+		}
+	}
+
 	//create a window
-	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "OpenGL", NULL, NULL);
+	if (!window)
+		window = glfwCreateWindow(WIDTH, HEIGHT, "OpenGL", NULL, NULL);
 	if (!window)
 	{
 		std::cout << "failed to create window" << std::endl;
@@ -62,11 +170,21 @@ int main()
 	}
 	glfwMakeContextCurrent(window);
 
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
+	if (!headless.enabled)
+	{
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		//unaccelerated, unscaled motion of the disabled cursor, where the platform has it
+		if (glfwRawMouseMotionSupported())
+			glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		//differs from the window size on high dpi displays
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
+		glfwSetKeyCallback(window, key_callback);
+		glfwSetWindowRefreshCallback(window, refresh_callback);
+	}
 
 	/*
 	*func can be registered as callback funcs
@@ -80,18 +198,156 @@ int main()
 		std::cout << "failed to init glad" << std::endl;
 		return -1;
 	}
+	loadGLExtensions();
 
+	if (!headless.enabled)
+		scheduler.init(window, parseSwapMode(headless.vsync), headless.framesInFlight);
 
 	glEnable(GL_DEPTH_TEST);
+	profiler.init();
 
-	//start to build shader program
-	Shader shader("shader/vmodel.glsl", "shader/fmodel.glsl");
+	//start to build shader programs, they compile while the models below load
+	ShaderLibrary shaders;
 	//Shader shader("shader/vlight.glsl", "shader/flight.glsl");
-	Shader lightShader("shader/vlight.glsl", "shader/f_light.glsl");
-
-	//Model suitModel("resources/objects/nanosuit/nanosuit.obj");
-	Model suitModel("resources/objects/ce/ce.obj");
+	Shader &lightShader = shaders.add("light", "shader/vlight.glsl", "shader/f_light.glsl");
+	//lit meshes use a variant per feature set (textures, normal map, skinning), submitted once a model is loaded
+	ShaderVariants modelShaders("shader/vmodel.glsl", "shader/fmodel.glsl");
+	ShaderPermutation staticPermutation(0, POINT_LIGHTS);
+	ShaderPermutation skinnedPermutation(FEATURE_SKINNING, POINT_LIGHTS);
+	ShaderPermutation clusteredStaticPermutation(FEATURE_CLUSTERED, 0);
+	ShaderPermutation clusteredSkinnedPermutation(FEATURE_SKINNING | FEATURE_CLUSTERED, 0);
+	useClusters = useClusters || headless.clustered;
+	useDeferred = useDeferred || headless.deferred;
+	useShadows = useShadows && headless.shadows;
+	onDemand.enabled = !headless.enabled && headless.onDemand;
+	setViews(headless.views);
+	//forward permutations of the first frame, compiled while the models load
+	ShaderPermutation forwardStatic = useClusters ? clusteredStaticPermutation : staticPermutation;
+	ShaderPermutation forwardSkinned = useClusters ? clusteredSkinnedPermutation : skinnedPermutation;
+	if (useShadows)
+	{
+		forwardStatic.features |= FEATURE_SHADOWS;
+		forwardSkinned.features |= FEATURE_SHADOWS;
+	}
+	ShaderPermutation geometryStaticPermutation(0, 0);
+	ShaderPermutation geometrySkinnedPermutation(FEATURE_SKINNING, 0);
+	DeferredRenderer deferred;
+	deferred.create(framebufferWidth, framebufferHeight, shaders);
+	useDepthPrepass = useDepthPrepass || headless.prepass;
+	ShaderPermutation depthStaticPermutation(FEATURE_DEPTH_ONLY, 0);
+	ShaderPermutation depthSkinnedPermutation(FEATURE_DEPTH_ONLY | FEATURE_SKINNING, 0);
+	DepthPrepass depthPrepass;
+	depthPrepass.init();
+	if (useDepthPrepass)
+	{
+		depthPrepass.shaders.prepare(depthStaticPermutation);
+		if (SKINNED_INSTANCES > 0)
+			depthPrepass.shaders.prepare(depthSkinnedPermutation);
+	}
+	useOcclusionCulling = useOcclusionCulling || headless.cull;
+	HiZCulling occlusion;
+	occlusion.create(framebufferWidth, framebufferHeight, shaders);
+	//size the full screen targets were made for
+	int targetWidth = framebufferWidth, targetHeight = framebufferHeight;
+	vector<glm::vec4> cullSpheres;	//scene meshBounds followed by one sphere per horse
+	CascadedShadows shadows;
+	shadows.create();
+	if (headless.particles > 0)
+	{
+		particles.create(headless.particles, lightPos, shaders);
+		particles.sorted = headless.sortedParticles;
+	}
+	useTransparency = useTransparency && headless.transparency;
+	WeightedBlendedOIT transparency;
+	transparency.create(framebufferWidth, framebufferHeight, shaders);
+	if (useShadows)
+	{
+		shadows.shaders.prepare(depthStaticPermutation);
+		if (SKINNED_INSTANCES > 0)
+			shadows.shaders.prepare(depthSkinnedPermutation);
+	}
 
+	//the nanosuit exports its visor material as opaque (d 1, alpha 255 in glass_dif.png)
+	unordered_map<string, float> suitOpacities = { { "Glass", SUIT_GLASS_OPACITY } };
+	//Model suitModel("resources/objects/nanosuit/nanosuit.obj", false, suitOpacities);
+	Model suitModel("resources/objects/ce/ce.obj", false, suitOpacities);
+	if (useDeferred)
+		suitModel.prepareShaders(deferred.geometryShaders, geometryStaticPermutation);
+	else
+		suitModel.prepareShaders(modelShaders, forwardStatic);
+	//link what the driver finished while the suit loaded, the rest is collected before the first frame
+	shaders.poll();
+
+	SceneGraph scene;
+	glm::mat4 suitTransform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.75f, 0.0f));
+	suitTransform = glm::scale(suitTransform, glm::vec3(0.2f));
+	scene.addModel(suitModel, -1, suitTransform);
+	glm::mat4 lightTransform = glm::translate(glm::mat4(1.0f), lightPos);
+	lightTransform = glm::scale(lightTransform, glm::vec3(0.2f));
+	unsigned int lightNode = scene.addNode("light", -1, lightTransform);
+
+	//poses of the whole crowd are evaluated in parallel on the job system
+	JobSystem jobs;
+	Model *horseModel = nullptr;
+	PoseClip *horseClip = nullptr;
+	PoseCrowd *crowd = nullptr;
+	vector<unsigned int> horseNodes;
+	vector<unsigned int> horseOrder;	//indices into horseNodes, nearest first
+	vector<glm::vec4> horseBounds;	//world bounding spheres, refreshed every frame
+	vector<unsigned char> horseInFrustum;	//per horse node, refreshed when the camera or the scene changed
+	//camera and scene versions the node matrices were last projected with
+	unsigned int projectedCamera = 0, projectedScene = 0;
+	if (SKINNED_INSTANCES > 0)
+	{
+		horseModel = new Model("resources/objects/horse/ylm.FBX");
+		if (useDeferred)
+			horseModel->prepareShaders(deferred.geometryShaders, geometrySkinnedPermutation);
+		else
+			horseModel->prepareShaders(modelShaders, forwardSkinned);
+		horseClip = new PoseClip(*horseModel, 0);
+		crowd = new PoseCrowd(*horseModel, *horseClip, SKINNED_INSTANCES, jobs.workerCount());
+		unsigned int crowdNode = scene.addNode("crowd", -1, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.75f, -4.0f)));
+		unsigned int side = (unsigned int)std::ceil(std::sqrt((float)SKINNED_INSTANCES));
+		for (unsigned int i = 0; i < SKINNED_INSTANCES; ++i)
+		{
+			glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3((i % side) * 1.5f - side * 0.75f, 0.0f, -(float)(i / side) * 1.5f));
+			horseNodes.push_back(scene.addNode("horse", crowdNode, glm::scale(transform, glm::vec3(SKINNED_SCALE))));
+			horseOrder.push_back(i);
+			//stagger the start times so the instances do not move in lockstep
+			crowd->setTime(i, i * 0.37f);
+		}
+	}
+	BonePalette bonePalette(std::max(SKINNED_INSTANCES, 1u));
+
+	//small colored lights scattered over the suit and the crowd, each drifting on its own circle
+	ClusteredLights lightClusters;
+	lightClusters.setViewport(framebufferWidth, framebufferHeight);
+	vector<glm::vec4> stressLights;	//base position, phase
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (unsigned int i = 0; i < STRESS_LIGHTS; ++i)
+		stressLights.push_back(glm::vec4(unit(random) * 16.0f - 8.0f, unit(random) * 2.0f - 1.7f, unit(random) * 18.0f - 15.0f, unit(random) * 6.2832f));
+
+	shaders.finish();
+	modelShaders.setSetup([](Shader &shader) { shader.setBlockBinding("Bones", BONE_BINDING); });
+	modelShaders.finish();
+	deferred.geometryShaders.setSetup([](Shader &shader) { shader.setBlockBinding("Bones", BONE_BINDING); });
+	deferred.geometryShaders.finish();
+	depthPrepass.shaders.setSetup([](Shader &shader) { shader.setBlockBinding("Bones", BONE_BINDING); });
+	depthPrepass.shaders.finish();
+	shadows.shaders.setSetup([](Shader &shader) { shader.setBlockBinding("Bones", BONE_BINDING); });
+	shadows.shaders.finish();
+
+	//edited glsl files are rebuilt in the background and swapped in on the next use
+	ShaderReloader shaderReloader;
+	if (!headless.enabled && shaderReloader.start(window, "shader"))
+	{
+		shaders.watch(shaderReloader);
+		modelShaders.watch(shaderReloader);
+		deferred.geometryShaders.watch(shaderReloader);
+		depthPrepass.shaders.watch(shaderReloader);
+		shadows.shaders.watch(shaderReloader);
+	}
 
 	//set up vertices
 	float vertices[] = {
@@ -184,81 +440,536 @@ int main()
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
 
+	//headless frames go to an offscreen framebuffer and follow a scripted camera path
+	OffscreenTarget offscreen;
+	CameraPath cameraPath;
+	FrameTimings frameTimings;
+	vector<unsigned char> pixels;
+	unsigned int frameIndex = 0;
+	if (headless.enabled)
+	{
+		if (!offscreen.create(WIDTH, HEIGHT))
+		{
+			glfwTerminate();
+			return -1;
+		}
+		std::cout << "headless: " << headless.frames << " frames on " << glGetString(GL_RENDERER) << std::endl;
+		if (!headless.tracePath.empty())
+			profiler.startCapture();
+	}
+
+	//glfw's timer starts at glfwInit
+	std::cout << "startup: " << glfwGetTime() * 1000.0 << " ms, shaders " << shaders.loadMs + modelShaders.loadMs() + deferred.loadMs() + depthPrepass.shaders.loadMs() << " ms ("
+		<< modelShaders.size() << " model variants)"
+		<< (glExtensions().programBinary ? "" : " (no program binary support)") << std::endl;
+
+	if (!headless.enabled)
+		simulation.start(camera);
+
 	//rendering loop
 	//check whether the window is closed
-	while (!glfwWindowShouldClose(window))
+	while (headless.enabled ? frameIndex < headless.frames : !glfwWindowShouldClose(window))
 	{
 		//per-frame
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
+		profiler.beginFrame();
+		depthPrepass.beginFrame();
+		PROFILE_SCOPE("frame");
+		double frameStart = glfwGetTime();
+		double currentFrame;
+		if (headless.enabled)
+		{
+			currentFrame = frameIndex * (double)HEADLESS_DELTA_TIME;
+			cameraPath.apply(camera, (float)currentFrame);
+			offscreen.bind();
+		}
+		else
+		{
+			//may wait for the gpu, so input below is as fresh as possible
+			scheduler.beginFrame();
+			currentFrame = scheduler.time;
+		}
+		deltaTime = (float)(currentFrame - lastFrame);
 		lastFrame = currentFrame;
+		if (animate)
+			animationTime += deltaTime;
+		bool report = currentFrame - lastReport > REPORT_INTERVAL;
+		if (report)
+			lastReport = currentFrame;
 
 		//check input
-		processInput(window);
+		if (!headless.enabled)
+		{
+			processInput(window);
+			simulation.sample().apply(camera);
+		}
+		//programs rebuilt by the reload thread, swapped in before the frame sets any uniform
+		shaderReloader.swapReloaded();
 
 		//rendering operations
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);	//func set gl state
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	//func use gl state
 
+		//the g-buffer, the depth copies and the cluster tiles follow the framebuffer, e.g. after a resize or on a high dpi display
+		if (framebufferWidth != targetWidth || framebufferHeight != targetHeight)
+		{
+			targetWidth = framebufferWidth;
+			targetHeight = framebufferHeight;
+			deferred.resize(targetWidth, targetHeight);
+			occlusion.resize(targetWidth, targetHeight);
+			transparency.resize(targetWidth, targetHeight);
+			lightClusters.setViewport(targetWidth, targetHeight);
+		}
+
 		//draw 
-		shader.use();
-		//shader.setBool("useTexture", false);
-
-		glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.getViewMatrix();
-		shader.setMat4("projection", projection);
-		shader.setMat4("view", view);
-
-		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0f, -1.75f, 0.0f));
-		model = glm::scale(model, glm::vec3(0.2f));
-		shader.setMat4("model", model);
-		
-		shader.setFloat("material.shininess", 32.0f);
-		shader.setVec3("viewPos", camera.position);
-		shader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-		shader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-		shader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-		shader.setVec3("pointLight.position", lightPos);
-		shader.setVec3("pointLight.diffuse", 0.8f, 0.8f, 0.8f);
-		shader.setVec3("pointLight.specular", 1.0f, 1.0f, 1.0f);
-		shader.setFloat("pointLight.constant", 1.0f);
-		shader.setFloat("pointLight.linear", 0.09);
-		shader.setFloat("pointLight.quadratic", 0.032);
-		shader.setVec3("spotLight.position", camera.position);
-		shader.setVec3("spotLight.direction", camera.front);
-		shader.setVec3("spotLight.diffuse", 0.8f, 0.8f, 0.8f);
-		shader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-		shader.setFloat("spotLight.constant", 1.0f);
-		shader.setFloat("spotLight.linear", 0.09);
-		shader.setFloat("spotLight.quadratic", 0.032);
-		shader.setFloat("spotLight.cutoff", glm::cos(glm::radians(10.0f)));
-		shader.setFloat("spotLight.outerCutoff", glm::cos(glm::radians(15.0f)));
-
-		suitModel.draw(shader);
-
-		lightShader.use();
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, lightPos);
-		model = glm::scale(model, glm::vec3(0.2f));
-
-		lightShader.setMat4("model", model);
-		lightShader.setMat4("view", view);
-		lightShader.setMat4("projection", projection);
-
-		glBindVertexArray(VAO[1]);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		//rebuilt only when the camera moved or the window was resized
+		float aspect = (float)framebufferWidth / (float)framebufferHeight;
+		bool cameraMoved = camera.update(aspect, NEAR_PLANE, FAR_PLANE);
+		const glm::mat4 &projection = camera.projection;
+		const glm::mat4 &view = camera.view;
+		bool splitScreen = multiView.count() > 1;
+		if (splitScreen)
+		{
+			//view 0 follows the camera, the orientation is copied so an unchanged camera keeps its version
+			Camera &first = multiView.cameras[0];
+			first.position = camera.position;
+			first.zoom = camera.zoom;
+			first.setOrientation(camera.yaw, camera.pitch);
+			multiView.layout(framebufferWidth, framebufferHeight);
+			multiView.updateCameras(NEAR_PLANE, FAR_PLANE);
+		}
+
+		//only subtrees whose local transform changed are recomputed
+		bool sceneChanged = false;
+		{
+			PROFILE_SCOPE("scene update");
+			scene.update();
+			//shader matrices of every node for this camera, computed once instead of per vertex
+			sceneChanged = camera.version != projectedCamera || scene.version != projectedScene;
+			if (sceneChanged)
+			{
+				scene.setViewProjection(camera.viewProjection);
+				projectedCamera = camera.version;
+				projectedScene = scene.version;
+			}
+		}
+
+		{
+			PROFILE_SCOPE("lod select");
+			if (useLod)
+				scene.selectLod(camera.position, glm::radians(camera.zoom), (float)framebufferHeight, LOD_PIXEL_ERROR);
+			else
+				scene.resetLod();
+		}
+		if (report)
+		{
+			const LodStats &stats = scene.lodStats;
+			float saved = stats.fullTriangles ? 100.0f * (1.0f - (float)stats.drawnTriangles / stats.fullTriangles) : 0.0f;
+			std::cout << "lod: " << stats.drawnTriangles << " / " << stats.fullTriangles << " triangles, "
+				<< saved << "% saved" << std::endl;
+		}
+
+		if (useClusters || useDeferred)
+			updateClusterLights(lightClusters, stressLights, (float)animationTime);
+		//the clusters, the deferred path, the pre-pass and hi-z culling are built for the single view
+		if (useClusters && !useDeferred && !splitScreen)
+		{
+			lightClusters.update(view, projection, NEAR_PLANE, FAR_PLANE, jobs);
+			lightClusters.bind();
+			if (report)
+			{
+				const ClusterStats &stats = lightClusters.stats;
+				std::cout << "clusters: " << stats.visibleLights << " / " << stats.lights << " lights visible, "
+					<< stats.references << " references, at most " << stats.maxPerCluster << " per cluster, "
+					<< stats.dropped << " dropped, assign " << profiler.cpuAverage("light clusters") << " ms" << std::endl;
+			}
+		}
+
+		//nearest first, for the pre-pass or for early depth rejection in the colour pass
+		scene.sortFrontToBack(camera.position);
+		scene.transparency = useTransparency;
+		std::sort(horseOrder.begin(), horseOrder.end(), [&](unsigned int a, unsigned int b) {
+			return glm::distance(glm::vec3(scene.world(horseNodes[a])[3]), camera.position)
+				< glm::distance(glm::vec3(scene.world(horseNodes[b])[3]), camera.position);
+		});
+
+		horseBounds.clear();
+		for (unsigned int node : horseNodes)
+			horseBounds.push_back(horseModel->boundingSphere(scene.world(node), HORSE_BOUNDS_INFLATE));
+		//horses outside the view are skipped by every camera pass, the test only reruns when something moved
+		if (sceneChanged)
+		{
+			horseInFrustum.resize(horseBounds.size());
+			for (unsigned int i = 0; i < horseBounds.size(); ++i)
+				horseInFrustum[i] = camera.frustum.intersects(horseBounds[i]);
+		}
+
+		//binds its own program, so it runs before the frame uniforms of the variants
+		const unsigned char *sceneVisible = nullptr, *horseVisible = nullptr;
+		if (useOcclusionCulling && !splitScreen)
+		{
+			PROFILE_SCOPE("occlusion test");
+			cullSpheres.assign(scene.meshBounds.begin(), scene.meshBounds.end());
+			cullSpheres.insert(cullSpheres.end(), horseBounds.begin(), horseBounds.end());
+			const vector<unsigned char> &visible = occlusion.collect(cullSpheres.size());
+			sceneVisible = visible.data();
+			horseVisible = visible.data() + scene.meshBounds.size();
+			occlusion.test(cullSpheres);
+		}
+		else
+			occlusion.invalidate();
+
+		//poses first, the shadows and the depth pre-pass need the bone matrices too
+		if (horseModel)
+		{
+			PROFILE_SCOPE("skinning pose");
+			if (animate)
+			{
+				crowd->update(deltaTime, jobs, bonePalette);
+				bonePalette.upload();
+			}
+		}
+
+		//only cascades whose contents changed are drawn, static casters come from a cache
+		if (useShadows)
+		{
+			PROFILE_SCOPE("shadows");
+			if (splitScreen)
+			{
+				//the cascades cover every view, each samples the same maps
+				ShadowView shadowViews[MAX_VIEWS];
+				for (unsigned int v = 0; v < multiView.count(); ++v)
+				{
+					const Camera &viewCamera = multiView.cameras[v];
+					shadowViews[v] = { viewCamera.view, 1.0f / viewCamera.projection[0][0], 1.0f / viewCamera.projection[1][1], viewCamera.version };
+				}
+				shadows.update(shadowViews, multiView.count(), NEAR_PLANE, lightDirection, scene.version);
+			}
+			else
+				shadows.update(view, glm::radians(camera.zoom), aspect, NEAR_PLANE, lightDirection, scene.version, camera.version);
+			shadows.render(profiler, [&](const glm::mat4 &lightViewProjection) {
+				scene.drawDepth(shadows.shaders, depthStaticPermutation, lightViewProjection);
+			}, [&](const glm::mat4 &lightViewProjection) {
+				for (unsigned int i = 0; i < horseNodes.size(); ++i)
+				{
+					bonePalette.bind(i);
+					horseModel->drawDepth(shadows.shaders, depthSkinnedPermutation, ObjectTransform(scene.world(horseNodes[i]), lightViewProjection));
+				}
+			}, horseBounds);
+			shadows.bind();
+			if (report)
+				shadows.report(std::cout, profiler);
+		}
+
+		//frame uniforms of split screen view v, kept by the variants for programs finished later, so the view is captured by index
+		auto beginView = [&](unsigned int v) {
+			modelShaders.setFrameUniforms([&, v](Shader &shader) {
+				const Camera &viewCamera = multiView.cameras[v];
+				shader.setMat4("projection", viewCamera.projection);
+				shader.setMat4("view", viewCamera.view);
+				setLightUniforms(shader);
+				shader.setVec3("viewPos", viewCamera.position);
+				if (useShadows)
+					shadows.setUniforms(shader);
+			});
+		};
+
+		//split screen draws the views from one sorted queue instead of the single view passes
+		if (splitScreen)
+		{
+			ShaderPermutation viewStatic = staticPermutation, viewSkinned = skinnedPermutation;
+			if (useShadows)
+			{
+				viewStatic.features |= FEATURE_SHADOWS;
+				viewSkinned.features |= FEATURE_SHADOWS;
+			}
+			{
+				PROFILE_SCOPE("view queue");
+				cullSpheres.assign(scene.meshBounds.begin(), scene.meshBounds.end());
+				cullSpheres.insert(cullSpheres.end(), horseBounds.begin(), horseBounds.end());
+				multiView.cull(cullSpheres, scene.version);
+				multiView.buildQueue(scene, cullSpheres, viewStatic);
+			}
+			{
+				PROFILE_GPU_SCOPE(profiler, "views draw");
+				multiView.submit(scene, modelShaders, beginView, [&](unsigned int i, const glm::mat4 &viewProjection) {
+					bonePalette.bind(i);
+					ObjectTransform transform = scene.transform(horseNodes[i]);
+					transform.project(viewProjection);
+					horseModel->draw(modelShaders, viewSkinned, transform);
+				});
+			}
+			if (report)
+				multiView.report(std::cout, profiler.cpuAverage("view queue"), profiler.gpuAverage("views draw"));
+		}
+		else
+		{
+			modelShaders.setFrameUniforms([&](Shader &shader) {
+				shader.setMat4("projection", projection);
+				shader.setMat4("view", view);
+				setLightUniforms(shader);
+				if (useClusters)
+					lightClusters.setUniforms(shader);
+				if (useShadows)
+					shadows.setUniforms(shader);
+			});
+
+			//the deferred path writes its g-buffer in the colour pass, the pre-pass is for the forward paths
+			bool prepass = useDepthPrepass && !useDeferred;
+			if (prepass)
+			{
+				PROFILE_GPU_SCOPE(profiler, "depth prepass");
+				depthPrepass.shaders.setFrameUniforms([&](Shader &shader) {
+					shader.setMat4("projection", projection);
+					shader.setMat4("view", view);
+				});
+				depthPrepass.beginDepth();
+				scene.drawDepth(depthPrepass.shaders, depthStaticPermutation, sceneVisible);
+				for (unsigned int i : horseOrder)
+				{
+					if (!horseInFrustum[i] || (horseVisible && !horseVisible[i]))
+						continue;
+					bonePalette.bind(i);
+					horseModel->drawDepth(depthPrepass.shaders, depthSkinnedPermutation, scene.transform(horseNodes[i]));
+				}
+				depthPrepass.endDepth();
+			}
+
+			//the deferred path draws the same meshes into its g-buffer and lights them afterwards
+			ShaderVariants &sceneShaders = useDeferred ? deferred.geometryShaders : modelShaders;
+			ShaderPermutation sceneStatic = useDeferred ? geometryStaticPermutation : useClusters ? clusteredStaticPermutation : staticPermutation;
+			ShaderPermutation sceneSkinned = useDeferred ? geometrySkinnedPermutation : useClusters ? clusteredSkinnedPermutation : skinnedPermutation;
+			//the g-buffer holds no lighting, the deferred directional pass samples the shadows
+			if (useShadows && !useDeferred)
+			{
+				sceneStatic.features |= FEATURE_SHADOWS;
+				sceneSkinned.features |= FEATURE_SHADOWS;
+			}
+			if (useDeferred)
+			{
+				deferred.geometryShaders.setFrameUniforms([&](Shader &shader) {
+					shader.setMat4("projection", projection);
+					shader.setMat4("view", view);
+				});
+				deferred.beginGeometry();
+			}
+
+			//after a pre-pass GL_EQUAL already rejects every hidden fragment, so meshes stay grouped by variant
+			depthPrepass.beginColor(prepass);
+			{
+				PROFILE_GPU_SCOPE(profiler, "model draw");
+				scene.draw(sceneShaders, sceneStatic, !prepass, sceneVisible);
+			}
+			unsigned int culledHorses = 0;
+
+			if (horseModel)
+			{
+				PROFILE_GPU_SCOPE(profiler, "skinned draw");
+				for (unsigned int i : horseOrder)
+				{
+					if (!horseInFrustum[i])
+						continue;
+					if (horseVisible && !horseVisible[i])
+					{
+						++culledHorses;
+						continue;
+					}
+					bonePalette.bind(i);
+					horseModel->draw(sceneShaders, sceneSkinned, scene.transform(horseNodes[i]));
+				}
+
+				if (report)
+				{
+					//averages of the previous report interval
+					double updateMs = profiler.cpuAverage("skinning pose");
+					std::cout << "skinning: " << crowd->size() << " instances on " << jobs.workerCount() << " threads, pose "
+						<< updateMs << " ms (" << (updateMs > 0.0 ? crowd->size() / updateMs : 0.0) << " characters/ms), draw "
+						<< profiler.gpuAverage("skinned draw") << " ms" << std::endl;
+				}
+			}
+			depthPrepass.endColor();
+			if (report)
+				depthPrepass.report(std::cout, framebufferWidth * framebufferHeight);
+
+			if (useDeferred)
+			{
+				PROFILE_GPU_SCOPE(profiler, "deferred lights");
+				deferred.light(lightClusters, view, projection, [&](Shader &shader) {
+					setLightUniforms(shader);
+					if (useShadows)
+						shadows.setUniforms(shader);
+				}, useShadows);
+			}
+
+			//depth of the opaque scene for the occlusion test of the next frames
+			if (useOcclusionCulling)
+			{
+				PROFILE_GPU_SCOPE(profiler, "hi-z pyramid");
+				occlusion.reduce(camera.viewProjection);
+			}
+			if (useOcclusionCulling && report)
+			{
+				size_t horseTriangles = 0;
+				if (horseModel)
+					for (const Mesh &mesh : horseModel->meshes)
+						horseTriangles += mesh.triangleCount(0);
+				unsigned int horseDraws = horseModel ? (unsigned int)horseModel->meshes.size() : 0;
+				std::cout << "occlusion: " << scene.culledDraws + culledHorses * horseDraws << " / " << scene.meshBounds.size() + horseNodes.size() * horseDraws
+					<< " draws culled, " << scene.culledTriangles + culledHorses * horseTriangles << " triangles, "
+					<< occlusion.stats.culled << " / " << occlusion.stats.tested << " spheres hidden, test " << profiler.cpuAverage("occlusion test")
+					<< " ms, pyramid " << profiler.gpuAverage("hi-z pyramid") << " ms gpu";
+				if (occlusion.stats.pending)
+					std::cout << " (" << occlusion.stats.pending << " tests still pending, dropped)";
+				std::cout << std::endl;
+				occlusion.stats.pending = 0;
+			}
+
+			if (report)
+			{
+				//gpu time of the lit scene, toggle C, F and Z to compare the paths
+				double sceneMs = profiler.gpuAverage("depth prepass") + profiler.gpuAverage("model draw") + profiler.gpuAverage("skinned draw")
+					+ profiler.gpuAverage("deferred lights");
+				std::cout << "lighting: " << (useDeferred ? "deferred" : useClusters ? "clustered forward" : "forward")
+					<< (useDepthPrepass && !useDeferred ? " with depth pre-pass" : "") << (useShadows ? ", shadowed" : ", no shadows") << ", scene " << sceneMs << " ms gpu" << std::endl;
+			}
+		}
+
+		{
+			PROFILE_GPU_SCOPE(profiler, "light cube");
+			lightShader.use();
+			glBindVertexArray(VAO[1]);
+			GLint viewport[4];
+			glGetIntegerv(GL_VIEWPORT, viewport);
+			for (unsigned int v = 0; v < (splitScreen ? multiView.count() : 1); ++v)
+			{
+				const Camera &viewCamera = splitScreen ? multiView.cameras[v] : camera;
+				if (splitScreen)
+					glViewport(multiView.viewports[v].x, multiView.viewports[v].y, multiView.viewports[v].width, multiView.viewports[v].height);
+				ObjectTransform(scene.world(lightNode), viewCamera.viewProjection).apply(lightShader);
+				glDrawArrays(GL_TRIANGLES, 0, 36);
+			}
+			glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		}
+
+		//glass and other transparent materials after every opaque draw, lit by the forward shaders in every path
+		if (useTransparency)
+		{
+			ShaderPermutation transparentStatic = useClusters && !useDeferred && !splitScreen ? clusteredStaticPermutation : staticPermutation;
+			transparentStatic.features |= FEATURE_TRANSPARENT;
+			if (useShadows)
+				transparentStatic.features |= FEATURE_SHADOWS;
+			unsigned int transparentDraws = 0;
+			{
+				PROFILE_GPU_SCOPE(profiler, "transparency accumulate");
+				transparency.begin();
+				if (splitScreen)
+				{
+					GLint viewport[4];
+					glGetIntegerv(GL_VIEWPORT, viewport);
+					for (unsigned int v = 0; v < multiView.count(); ++v)
+					{
+						glViewport(multiView.viewports[v].x, multiView.viewports[v].y, multiView.viewports[v].width, multiView.viewports[v].height);
+						beginView(v);
+						transparentDraws += scene.drawTransparent(modelShaders, transparentStatic, multiView.cameras[v].viewProjection);
+					}
+					glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+				}
+				else
+					transparentDraws = scene.drawTransparent(modelShaders, transparentStatic, camera.viewProjection);
+			}
+			{
+				PROFILE_GPU_SCOPE(profiler, "transparency composite");
+				transparency.composite();
+			}
+			if (report)
+				transparency.report(std::cout, transparentDraws, profiler.gpuAverage("transparency accumulate"), profiler.gpuAverage("transparency composite"));
+		}
+
+		//transparent, after every opaque draw
+		if (particles.count())
+		{
+			{
+				PROFILE_GPU_SCOPE(profiler, "particle simulate");
+				particles.simulate(animate ? deltaTime : 0.0f, (float)animationTime);
+			}
+			if (particles.sorted)
+			{
+				PROFILE_GPU_SCOPE(profiler, "particle sort");
+				//view 0 follows the main camera, one order per frame is sorted for its eye
+				particles.sort(camera.position);
+			}
+			{
+				PROFILE_GPU_SCOPE(profiler, "particle draw");
+				GLint viewport[4];
+				glGetIntegerv(GL_VIEWPORT, viewport);
+				for (unsigned int v = 0; v < (splitScreen ? multiView.count() : 1); ++v)
+				{
+					const Camera &viewCamera = splitScreen ? multiView.cameras[v] : camera;
+					if (splitScreen)
+						glViewport(multiView.viewports[v].x, multiView.viewports[v].y, multiView.viewports[v].width, multiView.viewports[v].height);
+					particles.draw(viewCamera.viewProjection, viewCamera.view, v == 0);
+				}
+				glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+			}
+			if (report)
+				particles.report(std::cout, profiler.gpuAverage("particle simulate"), profiler.gpuAverage("particle sort"), profiler.gpuAverage("particle draw"));
+		}
+
+		if (report)
+		{
+			profiler.report(std::cout);
+			if (!headless.enabled)
+			{
+				scheduler.report(std::cout);
+				simulation.report(std::cout);
+				onDemand.report(std::cout);
+			}
+		}
 
 
 		//glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);	//premitive type, vertices number, indice type, offset
 
 
+		if (headless.enabled)
+		{
+			//wait for the gpu so the time covers the whole frame
+			glFinish();
+			frameTimings.add((glfwGetTime() - frameStart) * 1000.0);
+			if (!headless.pngDirectory.empty() && frameIndex % headless.pngEvery == 0)
+			{
+				offscreen.readPixels(pixels);
+				if (!png::write(framePath(headless.pngDirectory, frameIndex), WIDTH, HEIGHT, pixels.data()))
+					std::cout << "failed to write " << framePath(headless.pngDirectory, frameIndex) << std::endl;
+			}
+			++frameIndex;
+			continue;
+		}
+
 		//double buffer used to avoid flicker, when output the front buffers , the back buffers are used to /render/
-		glfwSwapBuffers(window);
+		scheduler.endFrame();
 		//check whether there are I/O events happened and handle them by callback func
-		glfwPollEvents();
+		//in on-demand mode this waits while nothing moves
+		onDemand.frameDrawn();
+		bool animating = animate && (horseModel || useClusters || useDeferred || particles.count());
+		onDemand.wait(animating || cameraMoved, [&]() { return simulation.takeChanged() || shaderReloader.takeReloaded(); });
+		simulation.flushInput();
+		scheduler.inputSampled();
+	}
+
+	if (headless.enabled)
+	{
+		frameTimings.report(std::cout);
+		if (!frameTimings.writeCsv(headless.timingsPath))
+			std::cout << "failed to write " << headless.timingsPath << std::endl;
+		if (profiler.isCapturing() && !profiler.writeChromeTrace(headless.tracePath))
+			std::cout << "failed to write " << headless.tracePath << std::endl;
 	}
 
+	shaderReloader.stop();
+	simulation.stop();
+	delete crowd;
+	delete horseClip;
+	delete horseModel;
+
 	//deallocate resources
 	//glDeleteVertexArrays(2, VAO);
 	//glDeleteBuffers(1, VBO);
@@ -277,6 +988,74 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
 	//note: opengl viewport can be smaller than the glfw window
 	glViewport(0, 0, width, height);
+	//zero while minimized, keep the last aspect
+	if (width > 0 && height > 0)
+	{
+		framebufferWidth = width;
+		framebufferHeight = height;
+	}
+	onDemand.markDirty();
+}
+
+//view 0 follows the camera, the others look at the orbit target of the headless path from fixed points around it
+void setViews(unsigned int count)
+{
+	multiView.resize(count, camera);
+	CameraPath path;
+	for (unsigned int v = 1; v < multiView.count(); ++v)
+	{
+		float angle = glm::two_pi<float>() * v / MAX_VIEWS;
+		Camera &view = multiView.cameras[v];
+		view.position = path.target + glm::vec3(glm::sin(angle), 1.0f, glm::cos(angle)) * path.radius * 2.0f;
+		view.lookAt(path.target);
+	}
+}
+
+//the window was uncovered or resized, its contents are gone
+void refresh_callback(GLFWwindow* window)
+{
+	onDemand.markDirty();
+}
+
+void setLightUniforms(Shader &shader)
+{
+	shader.setFloat("material.shininess", 32.0f);
+	shader.setVec3("viewPos", camera.position);
+	shader.setVec3("dirLight.direction", lightDirection);
+	shader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
+	shader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+	shader.setVec3("pointLights[0].position", lightPos);
+	shader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
+	shader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
+	shader.setFloat("pointLights[0].constant", 1.0f);
+	shader.setFloat("pointLights[0].linear", 0.09);
+	shader.setFloat("pointLights[0].quadratic", 0.032);
+	shader.setVec3("spotLight.position", camera.position);
+	shader.setVec3("spotLight.direction", camera.front);
+	shader.setVec3("spotLight.diffuse", 0.8f, 0.8f, 0.8f);
+	shader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
+	shader.setFloat("spotLight.constant", 1.0f);
+	shader.setFloat("spotLight.linear", 0.09);
+	shader.setFloat("spotLight.quadratic", 0.032);
+	shader.setFloat("spotLight.cutoff", glm::cos(glm::radians(10.0f)));
+	shader.setFloat("spotLight.outerCutoff", glm::cos(glm::radians(15.0f)));
+}
+
+//the scene light and the camera spot light come first, same as the uniform path
+void updateClusterLights(ClusteredLights &clusters, const vector<glm::vec4> &stressLights, float time)
+{
+	vector<ClusterLight> &lights = clusters.lights;
+	lights.clear();
+	lights.push_back(ClusterLight::point(lightPos, glm::vec3(0.8f), 20.0f));
+	lights.push_back(ClusterLight::spot(camera.position, camera.front, glm::vec3(1.0f), 30.0f, 10.0f, 15.0f));
+	for (const glm::vec4 &light : stressLights)
+	{
+		float angle = time * 0.5f + light.w;
+		glm::vec3 position = glm::vec3(light) + glm::vec3(std::cos(angle) * 0.5f, std::sin(angle * 2.0f) * 0.2f, std::sin(angle) * 0.5f);
+		//hue from the phase, so neighbours differ
+		glm::vec3 color = glm::clamp(glm::abs(glm::mod(light.w + glm::vec3(0.0f, 4.0f, 2.0f), 6.0f) - 3.0f) - 1.0f, 0.0f, 1.0f);
+		lights.push_back(ClusterLight::point(position, color * 2.0f, 1.5f));
+	}
 }
 
 void processInput(GLFWwindow* window)
@@ -301,33 +1080,174 @@ void processInput(GLFWwindow* window)
 	{
 	}
 
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+	//WASD moves the camera on the simulation thread, see key_callback
+
+	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
 	{
-		camera.processKeyboard(move_t::FORWARD, deltaTime);
+		std::cout << "press q" << std::endl;
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			showMatrix = !showMatrix;
+			lastChange = current;
+		}
 	}
 
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+	if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
 	{
-		camera.processKeyboard(move_t::BACKWARD, deltaTime);
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			useShadows = !useShadows;
+			std::cout << "shadows " << (useShadows ? "on" : "off") << std::endl;
+			lastChange = current;
+		}
 	}
 
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+	if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS)
 	{
-		camera.processKeyboard(move_t::RIGHT, deltaTime);
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			SwapMode mode = scheduler.getSwapMode();
+			if (mode == SWAP_IMMEDIATE)
+				mode = SWAP_VSYNC;
+			else if (mode == SWAP_VSYNC && scheduler.supportsAdaptive())
+				mode = SWAP_ADAPTIVE;
+			else
+				mode = SWAP_IMMEDIATE;
+			scheduler.setSwapMode(mode);
+			std::cout << swapModeName(scheduler.getSwapMode()) << std::endl;
+			lastChange = current;
+		}
 	}
 
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+	if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
 	{
-		camera.processKeyboard(move_t::LEFT, deltaTime);
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			useLod = !useLod;
+			std::cout << "lod " << (useLod ? "on" : "off") << std::endl;
+			lastChange = current;
+		}
 	}
 
-	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
 	{
-		std::cout << "press q" << std::endl;
 		float current = glfwGetTime();
 		if (current - lastChange > 0.5)
 		{
-			showMatrix = !showMatrix;
+			useClusters = !useClusters;
+			std::cout << (useClusters ? "clustered lighting, " : "uniform lighting, ") << STRESS_LIGHTS << " stress lights "
+				<< (useClusters ? "on" : "off") << std::endl;
+			lastChange = current;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
+	{
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			useDeferred = !useDeferred;
+			std::cout << (useDeferred ? "deferred" : "forward") << " shading" << std::endl;
+			lastChange = current;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
+	{
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			useDepthPrepass = !useDepthPrepass;
+			std::cout << "depth pre-pass " << (useDepthPrepass ? "on" : "off") << std::endl;
+			lastChange = current;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
+	{
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			useOcclusionCulling = !useOcclusionCulling;
+			std::cout << "occlusion culling " << (useOcclusionCulling ? "on" : "off") << std::endl;
+			lastChange = current;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
+	{
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			onDemand.enabled = !onDemand.enabled;
+			std::cout << "render on demand " << (onDemand.enabled ? "on" : "off") << std::endl;
+			lastChange = current;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS)
+	{
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			setViews(multiView.count() % MAX_VIEWS + 1);
+			std::cout << multiView.count() << (multiView.count() > 1 ? " views" : " view") << std::endl;
+			lastChange = current;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS)
+	{
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			particles.sorted = !particles.sorted;
+			std::cout << "particles " << (particles.sorted ? "sorted, alpha blended" : "additive") << std::endl;
+			lastChange = current;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+	{
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			useTransparency = !useTransparency;
+			std::cout << "transparency " << (useTransparency ? "on" : "off") << std::endl;
+			lastChange = current;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
+	{
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			animate = !animate;
+			std::cout << "animation " << (animate ? "on" : "off") << std::endl;
+			lastChange = current;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
+	{
+		float current = glfwGetTime();
+		if (current - lastChange > 0.5)
+		{
+			if (profiler.isCapturing())
+			{
+				if (!profiler.writeChromeTrace(TRACE_PATH))
+					std::cout << "failed to write " << TRACE_PATH << std::endl;
+			}
+			else
+			{
+				std::cout << "capturing profile, press P again to write " << TRACE_PATH << std::endl;
+				profiler.startCapture();
+			}
 			lastChange = current;
 		}
 	}
@@ -347,12 +1267,27 @@ void mouse_callback(GLFWwindow* window, double xPos, double yPos)
 	lastX = xPos;
 	lastY = yPos;
 
-	camera.processMouseMovement(xOffset, yOffset);
+	simulation.addMouseMove(xOffset, yOffset);
+	//flushed to the simulation after the wait, which has to end for that
+	onDemand.markDirty();
 }
 
 void scroll_callback(GLFWwindow* window, double xOffset, double yOffset)
 {
-	camera.processMouseScroll(yOffset);
+	simulation.addScroll(yOffset);
+	onDemand.markDirty();
+}
+
+//movement keys as press and release events, the simulation keeps them held between ticks
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	//toggles are read by processInput on the next frame
+	onDemand.markDirty();
+	if (action == GLFW_REPEAT)
+		return;
+	int move = key == GLFW_KEY_W ? FORWARD : key == GLFW_KEY_S ? BACKWARD : key == GLFW_KEY_A ? LEFT : key == GLFW_KEY_D ? RIGHT : -1;
+	if (move >= 0)
+		simulation.pushKey(move, action == GLFW_PRESS);
 }
 
 unsigned int loadTexture(char const * path)
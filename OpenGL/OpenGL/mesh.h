@@ -6,6 +6,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "renderstats.h"
+#include "shadervariants.h"
 
 #include <string>
 #include <fstream>
@@ -16,6 +18,11 @@
 using std::vector;
 using std::string;
 
+//influences per vertex, matches aiProcess_LimitBoneWeights' default
+const int MAX_BONE_INFLUENCE = 4;
+//bones of one skeleton, must match MAX_BONES in shader/vmodel.glsl
+const unsigned int MAX_BONES = 100;
+
 struct Vertex {
 	glm::vec3 position;
 	glm::vec3 normal;
@@ -23,6 +30,8 @@ struct Vertex {
 	glm::vec3 tangent;
 	glm::vec3 bitangent;
 	glm::vec3 color;	//if no texture provided, check color;
+	glm::ivec4 boneIds;
+	glm::vec4 boneWeights;	//all zero for vertices that are not skinned
 };
 
 enum class texture_t_t { DIFFUSE, SPECULAR, NORMAL, HEIGHT };
@@ -32,23 +41,106 @@ struct Texture {
 	string path;
 };
 
+//one simplified index buffer of a mesh, level 0 is the original one
+struct LodLevel {
+	vector<unsigned int> indices;
+	float error;	//max geometric error in model space
+};
+
+//range of a lod inside the shared element buffer
+struct MeshLod {
+	unsigned int offset;
+	unsigned int count;
+	float error;
+};
+
 class Mesh {
 public:
 	vector<Vertex> vertices;
 	vector<unsigned int> indices;
 	vector<Texture> textures;
 	unsigned int VAO;
+	//positions only (plus the bone attributes of the full buffer) for depth-only passes
+	unsigned int depthVAO;
+	//all lods share the vertex buffer, their indices are appended to the same EBO
+	vector<MeshLod> lods;
+	//bounding sphere in model space
+	glm::vec3 center;
+	float radius;
+	//of the material, meshes below 1 are left to the transparency pass, see SceneGraph::transparency
+	float opacity = 1.0f;
 
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, vector<LodLevel> lodLevels = vector<LodLevel>())
 	{
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
 
-		setupMesh();
+		if (lodLevels.empty())
+			lodLevels.push_back({ indices, 0.0f });
+		setupMesh(lodLevels);
+	}
+
+	//shader features the textures of this mesh allow
+	unsigned int features() const
+	{
+		unsigned int result = 0;
+		for (const Texture &texture : textures)
+		{
+			if (texture.texture_t == texture_t_t::DIFFUSE)
+				result |= FEATURE_TEXTURED;
+			else if (texture.texture_t == texture_t_t::SPECULAR)
+				result |= FEATURE_SPECULAR_MAP;
+			else if (texture.texture_t == texture_t_t::NORMAL)
+				result |= FEATURE_NORMAL_MAP;
+		}
+		//specular maps only modulate textured surfaces
+		if (!(result & FEATURE_TEXTURED))
+			result &= ~FEATURE_SPECULAR_MAP;
+		return result;
+	}
+
+	bool transparent() const
+	{
+		return opacity < 1.0f;
+	}
+
+	unsigned int triangleCount(unsigned int level) const
+	{
+		return lods[level].count / 3;
+	}
+
+	//bounding sphere in world space, xyz center and w radius
+	glm::vec4 worldSphere(const glm::mat4 &world) const
+	{
+		float scale = glm::max(glm::length(glm::vec3(world[0])), glm::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+		return glm::vec4(glm::vec3(world * glm::vec4(center, 1.0f)), radius * scale);
+	}
+
+	//pick the coarsest lod whose error projected with pixelsPerUnit (at distance 1) stays below pixelError
+	unsigned int selectLod(const glm::mat4 &world, const glm::vec3 &viewPos, float pixelsPerUnit, float pixelError) const
+	{
+		glm::vec4 sphere = worldSphere(world);
+		float scale = radius > 0.0f ? sphere.w / radius : 1.0f;
+		float distance = glm::max(glm::length(glm::vec3(sphere) - viewPos) - sphere.w, 0.001f);
+
+		unsigned int level = 0;
+		for (unsigned int i = 1; i < lods.size(); ++i)
+		{
+			if (lods[i].error * scale * pixelsPerUnit / distance > pixelError)
+				break;
+			level = i;
+		}
+		return level;
 	}
 
+	//full detail, lods are chosen per scene node, see SceneGraph::selectLod
 	void draw(Shader &shader)
+	{
+		draw(shader, 0);
+	}
+
+	void draw(Shader &shader, unsigned int level)
 	{
 		unsigned int diffuseN = 0;
 		unsigned int specularN = 0;
@@ -89,19 +181,59 @@ public:
 			glBindTexture(GL_TEXTURE_2D, textures[i].id);
 		}
 
+		const MeshLod &lod = lods[level];
 		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+		glDrawElements(GL_TRIANGLES, lod.count, GL_UNSIGNED_INT, (void*)(lod.offset * sizeof(unsigned int)));
+
+		RenderStats &stats = renderStats();
+		++stats.drawCalls;
+		stats.triangles += lod.count / 3;
+		stats.textureBinds += (unsigned int)size;
+		++stats.vertexArrayBinds;
 
 		glBindVertexArray(0);
 		glActiveTexture(GL_TEXTURE0);
 	}
+
+	//depth-only draw from the tightly packed position stream, the shader must be in use
+	void drawDepth(unsigned int level) const
+	{
+		const MeshLod &lod = lods[level];
+		glBindVertexArray(depthVAO);
+		glDrawElements(GL_TRIANGLES, lod.count, GL_UNSIGNED_INT, (void*)(lod.offset * sizeof(unsigned int)));
+
+		RenderStats &stats = renderStats();
+		++stats.drawCalls;
+		stats.triangles += lod.count / 3;
+		++stats.vertexArrayBinds;
+
+		glBindVertexArray(0);
+	}
 	
 
 private:
-	unsigned int VBO, EBO;
+	unsigned int VBO, EBO, positionVBO;
 
-	void setupMesh()
+	void setupMesh(const vector<LodLevel> &lodLevels)
 	{
+		glm::vec3 minPos(vertices.empty() ? glm::vec3(0.0f) : vertices[0].position), maxPos(minPos);
+		for (const Vertex &vertex : vertices)
+		{
+			minPos = glm::min(minPos, vertex.position);
+			maxPos = glm::max(maxPos, vertex.position);
+		}
+		center = (minPos + maxPos) * 0.5f;
+		radius = 0.0f;
+		for (const Vertex &vertex : vertices)
+			radius = glm::max(radius, glm::length(vertex.position - center));
+
+		vector<unsigned int> elements;
+		for (const LodLevel &level : lodLevels)
+		{
+			lods.push_back({ (unsigned int)elements.size(), (unsigned int)level.indices.size(), level.error });
+			elements.insert(elements.end(), level.indices.begin(), level.indices.end());
+		}
+
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
@@ -112,7 +244,7 @@ private:
 		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(unsigned int), &elements[0], GL_STATIC_DRAW);
 
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
 		glEnableVertexAttribArray(0);
@@ -132,6 +264,37 @@ private:
 		glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
 		glEnableVertexAttribArray(5);
 
+		glVertexAttribIPointer(6, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, boneIds));
+		glEnableVertexAttribArray(6);
+
+		glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, boneWeights));
+		glEnableVertexAttribArray(7);
+
+		//12 bytes per vertex instead of sizeof(Vertex), the depth pass fetches far less memory
+		vector<glm::vec3> positions;
+		positions.reserve(vertices.size());
+		for (const Vertex &vertex : vertices)
+			positions.push_back(vertex.position);
+
+		glGenVertexArrays(1, &depthVAO);
+		glGenBuffers(1, &positionVBO);
+
+		glBindVertexArray(depthVAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+		glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+		glEnableVertexAttribArray(0);
+
+		//only read by the skinned variant
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glVertexAttribIPointer(6, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, boneIds));
+		glEnableVertexAttribArray(6);
+		glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, boneWeights));
+		glEnableVertexAttribArray(7);
+
 		glBindVertexArray(0);
 	}
 };
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 #include "stb_image.h"
 
@@ -13,6 +14,9 @@
 
 #include "shader.h"
 #include "mesh.h"
+#include "transform.h"
+#include "lod.h"
+#include "animation.h"
 
 #include <string>
 #include <fstream>
@@ -21,6 +25,8 @@
 #include <map>
 #include <vector>
 #include <unordered_map>
+#include <chrono>
+#include <cfloat>
 
 using std::vector;
 using std::string;
@@ -30,15 +36,48 @@ using std::unordered_map;
 
 unsigned int loadTexture(const string &path, const string &directory, bool gamma = false);
 
+//triangles of the last lod selection
+struct LodStats {
+	size_t fullTriangles = 0;
+	size_t drawnTriangles = 0;
+};
+
+//aiNode of the imported hierarchy, stored depth-first so a subtree is a contiguous range
+struct ModelNode {
+	string name;
+	int parent;					//-1 for the root
+	unsigned int subtreeSize;	//this node and all of its descendants
+	glm::mat4 transform;		//relative to the parent
+	vector<unsigned int> meshes;
+};
+
+struct BoneInfo {
+	string name;
+	glm::mat4 offset;	//mesh space to bone space in bind pose
+	int node;			//node animating the bone, -1 if the hierarchy has none
+};
+
+//assimp matrices are row major
+inline glm::mat4 toMat4(const aiMatrix4x4 &m)
+{
+	return glm::transpose(glm::make_mat4(&m.a1));
+}
+
 class Model
 {
 public:
 	unordered_map<string, Texture> textures_loaded;
 	vector<Mesh> meshes;
+	vector<ModelNode> nodes;
+	vector<BoneInfo> bones;
+	vector<Animation> animations;
+	glm::mat4 globalInverse = glm::mat4(1.0f);	//inverse of the root transform, bone matrices are relative to the model
 	string directory;
 	bool gammaCorrection;
 
-	Model(const string &path, bool gamma = false) :gammaCorrection(gamma)
+	//opacities replaces the opacity of the materials it names, for files that export a transparent material as opaque
+	Model(const string &path, bool gamma = false, const unordered_map<string, float> &opacities = unordered_map<string, float>())
+		:gammaCorrection(gamma), opacityOverrides(opacities)
 	{
 		loadModel(path);
 	}
@@ -49,11 +88,69 @@ public:
 			meshes[i].draw(shader);
 	}
 
+	//every mesh uses the variant its textures need, on top of the features of base
+	void draw(ShaderVariants &variants, const ShaderPermutation &base, const ObjectTransform &transform)
+	{
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			Shader &shader = variants.use(ShaderPermutation(base.features | meshes[i].features(), base.pointLights));
+			transform.apply(shader);
+			meshes[i].draw(shader);
+		}
+	}
+
+	//depth-only variants do not depend on the textures, base is used as is
+	void drawDepth(ShaderVariants &variants, const ShaderPermutation &base, const ObjectTransform &transform)
+	{
+		Shader &shader = variants.use(base);
+		transform.apply(shader);
+		for (size_t i = 0; i < meshes.size(); ++i)
+			meshes[i].drawDepth(0);
+	}
+
+	/*
+	*sphere around the bounding spheres of all meshes in world space
+	*inflate scales the radius, bind pose bounds of a skinned model do not hold every animated pose
+	*/
+	glm::vec4 boundingSphere(const glm::mat4 &world, float inflate = 1.0f) const
+	{
+		if (meshes.empty())
+			return glm::vec4(glm::vec3(world[3]), 0.0f);
+		glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+		for (const Mesh &mesh : meshes)
+		{
+			glm::vec4 sphere = mesh.worldSphere(world);
+			lo = glm::min(lo, glm::vec3(sphere) - sphere.w);
+			hi = glm::max(hi, glm::vec3(sphere) + sphere.w);
+		}
+		glm::vec3 center = (lo + hi) * 0.5f;
+		float radius = 0.0f;
+		for (const Mesh &mesh : meshes)
+		{
+			glm::vec4 sphere = mesh.worldSphere(world);
+			radius = glm::max(radius, glm::length(glm::vec3(sphere) - center) + sphere.w);
+		}
+		return glm::vec4(center, radius * inflate);
+	}
+
+	//submit the variants draw will need so they compile in the background
+	void prepareShaders(ShaderVariants &variants, const ShaderPermutation &base)
+	{
+		for (const Mesh &mesh : meshes)
+			variants.prepare(ShaderPermutation(base.features | mesh.features(), base.pointLights));
+	}
+
 private:
+	//simplified index buffers persisted next to the model file
+	vector<LodCacheEntry> lodCache;
+	bool lodCacheDirty = false;
+	unordered_map<string, unsigned int> boneMap;
+	unordered_map<string, float> opacityOverrides;	//material name to opacity
+
 	void loadModel(const string &path)
 	{
 		Assimp::Importer importer;
-		const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+		const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_LimitBoneWeights);
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 		{
 			cout << "failed to load model : " << importer.GetErrorString() << endl;
@@ -62,21 +159,49 @@ private:
 		directory = path.substr(0, path.find_last_of("/"));
 		cout << "model path : " << path << endl;
 		cout << "directory : " << directory << endl;
-		processNode(scene->mRootNode, scene);
+
+		string lodPath = path + ".lod";
+		if (!loadLodCache(lodPath, lodCache))
+			lodCache.clear();
+
+		auto start = std::chrono::steady_clock::now();
+		processNode(scene->mRootNode, scene, -1);
+		float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+		globalInverse = glm::inverse(nodes[0].transform);
+		if (bones.size() > MAX_BONES)
+			cout << "model has " << bones.size() << " bones, the shaders hold " << MAX_BONES
+				<< ", the influences of the rest are dropped" << endl;
+		resolveBoneNodes();
+		loadAnimations(scene);
+
+		if (lodCacheDirty)
+		{
+			lodCache.resize(meshes.size());
+			if (saveLodCache(lodPath, lodCache))
+				cout << "lod cache written to " << lodPath << endl;
+			else
+				cout << "failed to write lod cache " << lodPath << endl;
+		}
+		cout << "processed " << meshes.size() << " meshes in " << seconds << " s" << endl;
 	}
 
-	void processNode(aiNode *node, const aiScene *scene)
+	void processNode(aiNode *node, const aiScene *scene, int parent)
 	{
 		cout << "start process node - " << node->mName.C_Str() << endl;
+		unsigned int index = (unsigned int)nodes.size();
+		nodes.push_back({ node->mName.C_Str(), parent, 1, toMat4(node->mTransformation), vector<unsigned int>() });
 		for (size_t i = 0; i < node->mNumMeshes; ++i)
 		{
 			aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
+			nodes[index].meshes.push_back((unsigned int)meshes.size());
 			meshes.push_back(processMesh(mesh, scene));
 		}
 		for (size_t i = 0; i < node->mNumChildren; ++i)
 		{
-			processNode(node->mChildren[i], scene);
+			processNode(node->mChildren[i], scene, (int)index);
 		}
+		nodes[index].subtreeSize = (unsigned int)nodes.size() - index;
 		cout << "end process node - " << node->mName.C_Str() << endl;
 	}
 
@@ -139,9 +264,14 @@ private:
 			else
 				vertex.color = glm::vec3(1.0);
 
+			vertex.boneIds = glm::ivec4(0);
+			vertex.boneWeights = glm::vec4(0.0f);
+
 			vertices.push_back(vertex);
 		}
 
+		extractBoneWeights(vertices, mesh);
+
 		for (size_t i = 0; i < mesh->mNumFaces; ++i)
 		{
 			aiFace face = mesh->mFaces[i];
@@ -164,7 +294,151 @@ private:
 		vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, texture_t_t::HEIGHT);
 		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-		return Mesh(vertices, indices, textures);
+		Mesh result(vertices, indices, textures, meshLods(vertices, indices));
+		result.opacity = materialOpacity(material);
+		return result;
+	}
+
+	//the override given for the material name, else the opacity of the material
+	float materialOpacity(aiMaterial *material) const
+	{
+		aiString name;
+		material->Get(AI_MATKEY_NAME, name);
+		auto it = opacityOverrides.find(name.C_Str());
+		if (it != opacityOverrides.end())
+			return it->second;
+		float opacity = 1.0f;
+		material->Get(AI_MATKEY_OPACITY, opacity);
+		return opacity;
+	}
+
+	//aiProcess_LimitBoneWeights keeps at most MAX_BONE_INFLUENCE weights per vertex
+	void extractBoneWeights(vector<Vertex> &vertices, aiMesh *mesh)
+	{
+		for (size_t i = 0; i < mesh->mNumBones; ++i)
+		{
+			aiBone *bone = mesh->mBones[i];
+			string name = bone->mName.C_Str();
+			if (boneMap.find(name) == boneMap.end())
+			{
+				boneMap[name] = (unsigned int)bones.size();
+				bones.push_back({ name, toMat4(bone->mOffsetMatrix), -1 });
+			}
+			int boneId = (int)boneMap[name];
+			//past the Bones block of the shaders, dropped, the weights below are renormalized without it
+			if (boneId >= (int)MAX_BONES)
+				continue;
+
+			for (size_t j = 0; j < bone->mNumWeights; ++j)
+			{
+				Vertex &vertex = vertices[bone->mWeights[j].mVertexId];
+				for (int k = 0; k < MAX_BONE_INFLUENCE; ++k)
+				{
+					if (vertex.boneWeights[k] == 0.0f)
+					{
+						vertex.boneIds[k] = boneId;
+						vertex.boneWeights[k] = bone->mWeights[j].mWeight;
+						break;
+					}
+				}
+			}
+		}
+
+		//the limit step renormalizes, but weights of bones shared across meshes may still drift
+		for (Vertex &vertex : vertices)
+		{
+			float total = vertex.boneWeights.x + vertex.boneWeights.y + vertex.boneWeights.z + vertex.boneWeights.w;
+			if (total > 0.0f)
+				vertex.boneWeights /= total;
+		}
+	}
+
+	unordered_map<string, int> nodeIndices() const
+	{
+		unordered_map<string, int> nodeIndex;
+		for (size_t i = 0; i < nodes.size(); ++i)
+			nodeIndex[nodes[i].name] = (int)i;
+		return nodeIndex;
+	}
+
+	void resolveBoneNodes()
+	{
+		unordered_map<string, int> nodeIndex = nodeIndices();
+		for (BoneInfo &bone : bones)
+		{
+			auto it = nodeIndex.find(bone.name);
+			bone.node = it == nodeIndex.end() ? -1 : it->second;
+		}
+	}
+
+	void loadAnimations(const aiScene *scene)
+	{
+		unordered_map<string, int> nodeIndex = nodeIndices();
+
+		for (size_t i = 0; i < scene->mNumAnimations; ++i)
+		{
+			const aiAnimation *source = scene->mAnimations[i];
+			Animation animation;
+			animation.name = source->mName.C_Str();
+			animation.duration = (float)source->mDuration;
+			animation.ticksPerSecond = source->mTicksPerSecond != 0.0 ? (float)source->mTicksPerSecond : 25.0f;
+			animation.nodeChannels.assign(nodes.size(), -1);
+
+			for (size_t j = 0; j < source->mNumChannels; ++j)
+			{
+				const aiNodeAnim *nodeAnim = source->mChannels[j];
+				auto it = nodeIndex.find(nodeAnim->mNodeName.C_Str());
+				if (it == nodeIndex.end())
+					continue;
+
+				AnimationChannel channel;
+				channel.node = it->second;
+				for (size_t k = 0; k < nodeAnim->mNumPositionKeys; ++k)
+				{
+					const aiVectorKey &key = nodeAnim->mPositionKeys[k];
+					channel.positionTimes.push_back((float)key.mTime);
+					channel.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+				}
+				for (size_t k = 0; k < nodeAnim->mNumRotationKeys; ++k)
+				{
+					const aiQuatKey &key = nodeAnim->mRotationKeys[k];
+					channel.rotationTimes.push_back((float)key.mTime);
+					channel.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+				}
+				for (size_t k = 0; k < nodeAnim->mNumScalingKeys; ++k)
+				{
+					const aiVectorKey &key = nodeAnim->mScalingKeys[k];
+					channel.scaleTimes.push_back((float)key.mTime);
+					channel.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+				}
+
+				animation.nodeChannels[channel.node] = (int)animation.channels.size();
+				animation.channels.push_back(channel);
+			}
+
+			cout << "animation " << animation.name << " : " << animation.channels.size() << " channels, "
+				<< animation.duration / animation.ticksPerSecond << " s" << endl;
+			animations.push_back(animation);
+		}
+	}
+
+	//reuse the cached lods of the next mesh when they still match its buffers, otherwise simplify again
+	vector<LodLevel> meshLods(const vector<Vertex> &vertices, const vector<unsigned int> &indices)
+	{
+		size_t meshIndex = meshes.size();
+		if (lodCache.size() <= meshIndex)
+			lodCache.resize(meshIndex + 1);
+
+		LodCacheEntry &entry = lodCache[meshIndex];
+		if (entry.vertexCount == vertices.size() && !entry.levels.empty() && entry.levels[0].indices == indices)
+			return entry.levels;
+
+		entry.vertexCount = (unsigned int)vertices.size();
+		entry.levels = generateLods(vertices, indices);
+		lodCacheDirty = true;
+		cout << "generated " << entry.levels.size() << " lods, coarsest has "
+			<< entry.levels.back().indices.size() / 3 << " of " << indices.size() / 3 << " triangles" << endl;
+		return entry.levels;
 	}
 
 	vector<Texture> loadMaterialTextures(aiMaterial *material, aiTextureType type, texture_t_t texture_t)
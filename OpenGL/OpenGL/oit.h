@@ -0,0 +1,151 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "renderstats.h"
+#include "shaderlibrary.h"
+
+#include <iostream>
+
+/*
+*weighted blended order-independent transparency (McGuire and Bavoil 2013)
+*transparent surfaces are drawn once, in any order, into two targets tested against a copy of the opaque depth:
+*  accumulation RGBA16F: rgb the sum of the premultiplied colours times a depth weight,
+*                        a the product of (1 - alpha), the revealage of the opaque image
+*  coverage R16F:        the sum of alpha times the weight
+*gl 3.3 has no blend function per draw buffer, one glBlendFuncSeparate serves both targets:
+*colour channels add and alpha multiplies, which is why the revealage lives in the alpha of the first target
+*the composite pass lays the weighted average colour over the opaque image, covering 1 - revealage of it
+*/
+class WeightedBlendedOIT
+{
+public:
+	//width and height of the render target the transparent surfaces are composited over, the program is added to shaders
+	bool create(unsigned int _width, unsigned int _height, ShaderLibrary &shaders)
+	{
+		width = _width;
+		height = _height;
+
+		glGenFramebuffers(1, &FBO);
+		glGenRenderbuffers(1, &depth);
+		bool complete = allocate();
+
+		compositeShader = &shaders.add("transparency composite", "shader/vdeferred.glsl", "shader/foit.glsl");
+		glGenVertexArrays(1, &emptyVAO);
+		return complete;
+	}
+
+	//new targets for a framebuffer of another size
+	bool resize(unsigned int _width, unsigned int _height)
+	{
+		width = _width;
+		height = _height;
+		const unsigned int textures[2] = { accumulation, coverage };
+		glDeleteTextures(2, textures);
+		return allocate();
+	}
+
+	//copy the depth of the bound draw framebuffer and clear the targets, the transparent draws follow
+	void begin()
+	{
+		GLint bound = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+		target = (unsigned int)bound;
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		//nothing covers the opaque image yet
+		const GLfloat clearAccumulation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		const GLfloat clearCoverage[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+		glClearBufferfv(GL_COLOR, 1, clearCoverage);
+
+		//hidden by opaque surfaces, but transparent surfaces never hide each other
+		glDepthMask(GL_FALSE);
+		glEnable(GL_BLEND);
+		glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+	}
+
+	//blend the accumulated surfaces over the framebuffer bound at begin, the viewport has to cover it
+	void composite()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+		glDepthMask(GL_TRUE);
+		glDisable(GL_DEPTH_TEST);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		compositeShader->use();
+		compositeShader->setInt("accumulation", 0);
+		compositeShader->setInt("coverage", 1);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, accumulation);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, coverage);
+		glActiveTexture(GL_TEXTURE0);
+		glBindVertexArray(emptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		RenderStats &stats = renderStats();
+		stats.drawCalls += 1;
+		stats.triangles += 1;
+		stats.textureBinds += 2;
+		stats.vertexArrayBinds += 1;
+
+		glBindVertexArray(0);
+		glDisable(GL_BLEND);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	//draws is the number of transparent meshes of the last frame, the times are gpu averages
+	void report(std::ostream &out, unsigned int draws, double accumulateMs, double compositeMs)
+	{
+		out << "transparency: " << draws << " transparent draws, accumulate " << accumulateMs << " ms, composite "
+			<< compositeMs << " ms gpu" << std::endl;
+	}
+
+private:
+	unsigned int FBO = 0;
+	unsigned int accumulation = 0, coverage = 0, depth = 0;
+	unsigned int width = 0, height = 0;
+	unsigned int target = 0;
+	Shader *compositeShader = nullptr;
+	unsigned int emptyVAO = 0;
+
+	bool allocate()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		accumulation = attach(GL_COLOR_ATTACHMENT0, GL_RGBA16F, GL_RGBA);
+		coverage = attach(GL_COLOR_ATTACHMENT1, GL_R16F, GL_RED);
+		//same format as the render targets, so the opaque depth can be blitted
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawBuffers);
+
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (!complete)
+			std::cout << "transparency targets are incomplete" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return complete;
+	}
+
+	unsigned int attach(GLenum attachment, GLint internalFormat, GLenum format)
+	{
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <functional>
+
+//a static frame is redrawn at least this often, e.g. for file changes noticed without an event
+const double ON_DEMAND_TIMEOUT = 0.5;
+
+//cpu seconds of every thread of the process since it started
+double processCpuSeconds();
+
+/*
+*render on demand for the windowed loop
+*instead of polling every frame, wait blocks in glfwWaitEventsTimeout until something marks the next frame dirty:
+*an input event, a camera state published by the simulation or a reloaded shader
+*while an animation runs or the camera is still moving every frame is drawn as usual
+*/
+class RenderOnDemand
+{
+public:
+	bool enabled = false;
+
+	//from the glfw callbacks or any other reason to draw again
+	void markDirty()
+	{
+		dirty = true;
+	}
+
+	/*
+	*replaces glfwPollEvents after the swap, busy frames only poll
+	*woken is asked after every event and returns true when an outside source has a change
+	*/
+	void wait(bool busy, const std::function<bool()> &woken)
+	{
+		if (!enabled || busy)
+		{
+			glfwPollEvents();
+			dirty = false;
+			return;
+		}
+		dirty = false;
+		double start = glfwGetTime();
+		double last = start;
+		while (!dirty && !woken() && last - start < ON_DEMAND_TIMEOUT)
+		{
+			glfwWaitEventsTimeout(ON_DEMAND_TIMEOUT - (last - start));
+			last = glfwGetTime();
+		}
+		idleSeconds += last - start;
+		dirty = false;
+	}
+
+	void frameDrawn()
+	{
+		++frames;
+	}
+
+	//frames, idle time and cpu usage since the last report, 100% cpu is one core busy
+	void report(std::ostream &out)
+	{
+		double now = glfwGetTime();
+		double cpu = processCpuSeconds();
+		double seconds = now - lastReport;
+		if (lastReport > 0.0 && seconds > 0.0)
+			out << "on demand: " << (enabled ? "on" : "off") << ", " << frames / seconds << " frames/s, idle "
+				<< 100.0 * idleSeconds / seconds << "%, cpu " << 100.0 * (cpu - lastCpu) / seconds << "%" << std::endl;
+		lastReport = now;
+		lastCpu = cpu;
+		frames = 0;
+		idleSeconds = 0.0;
+	}
+
+private:
+	bool dirty = true;
+	unsigned int frames = 0;
+	double idleSeconds = 0.0;
+	double lastReport = 0.0, lastCpu = 0.0;
+};
\ No newline at end of file
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "renderstats.h"
+#include "shaderlibrary.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+using std::vector;
+
+//particle counts are rounded up to a power of two for the bitonic sort
+const unsigned int MAX_PARTICLES = 1u << 20;
+//width of the sort textures, the height follows from the count
+const unsigned int PARTICLE_SORT_WIDTH = 1024;
+//bitonic passes per frame, a sort of n particles takes log2(n) * (log2(n) + 1) / 2 of them
+const unsigned int PARTICLE_SORT_PASSES = 24;
+const float PARTICLE_LIFETIME = 4.0f;
+const float PARTICLE_SIZE = 0.02f;
+const float PARTICLE_SPEED = 2.0f;
+
+/*
+*particles simulated and drawn on the gpu, the cpu never touches their state after create
+*
+*state is two vec4 per particle (position and remaining life, velocity and seed) in two buffers,
+*each frame a vertex shader steps one into the other with transform feedback and respawns expired particles at the emitter
+*they are drawn as instanced camera facing quads that read the state through a texture buffer
+*
+*additive blending needs no order, alpha blending draws back to front: gl 3.3 has no compute shaders,
+*so a bitonic sort of (distance, index) pairs runs as full screen passes over rg32f textures,
+*spread over several frames, the finished order is drawn while the next one is sorted
+*/
+class ParticleSystem
+{
+public:
+	glm::vec3 emitter = glm::vec3(0.0f);
+	glm::vec3 color = glm::vec3(1.0f, 0.6f, 0.2f);
+	bool sorted = false;	//alpha blending back to front instead of additive
+
+	unsigned int count() const
+	{
+		return particles;
+	}
+
+	//frames a full sort takes with PARTICLE_SORT_PASSES per frame
+	unsigned int sortFrames() const
+	{
+		return (sortPasses() + PARTICLE_SORT_PASSES - 1) / PARTICLE_SORT_PASSES;
+	}
+
+	//needs a current gl context, the programs are added to shaders
+	void create(unsigned int requested, const glm::vec3 &_emitter, ShaderLibrary &shaders)
+	{
+		emitter = _emitter;
+		particles = 2;
+		while (particles < std::min(requested, MAX_PARTICLES))
+			particles <<= 1;
+		sortWidth = std::min(particles, PARTICLE_SORT_WIDTH);
+		sortHeight = particles / sortWidth;
+
+		//staggered lives so the emitter starts out in its steady state instead of one burst
+		vector<glm::vec4> initial(particles * 2);
+		unsigned int seed = 1;
+		for (unsigned int i = 0; i < particles; ++i)
+		{
+			initial[i * 2] = glm::vec4(emitter, PARTICLE_LIFETIME * (i + 0.5f) / particles);
+			initial[i * 2 + 1] = glm::vec4(randomDirection(seed) * PARTICLE_SPEED, (float)i);
+		}
+
+		glGenBuffers(2, states);
+		glGenVertexArrays(2, stateVAOs);
+		glGenTextures(2, stateTextures);
+		for (unsigned int i = 0; i < 2; ++i)
+		{
+			glBindVertexArray(stateVAOs[i]);
+			glBindBuffer(GL_ARRAY_BUFFER, states[i]);
+			glBufferData(GL_ARRAY_BUFFER, initial.size() * sizeof(glm::vec4), initial.data(), GL_DYNAMIC_COPY);
+			glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)0);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)sizeof(glm::vec4));
+			glEnableVertexAttribArray(1);
+			glBindTexture(GL_TEXTURE_BUFFER, stateTextures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, states[i]);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		glGenTextures(3, orderTextures);
+		glGenFramebuffers(3, orderFBOs);
+		for (unsigned int i = 0; i < 3; ++i)
+		{
+			glBindTexture(GL_TEXTURE_2D, orderTextures[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, sortWidth, sortHeight, 0, GL_RG, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, orderFBOs[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, orderTextures[i], 0);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glGenVertexArrays(1, &emptyVAO);
+
+		simulateShader = &shaders.add("particle simulate", "shader/vparticlesim.glsl", "shader/fdepth.glsl", {},
+			{ "PositionLife", "VelocitySeed" });
+		keyShader = &shaders.add("particle sort keys", "shader/vdeferred.glsl", "shader/fparticlesort.glsl", { "KEYS" });
+		mergeShader = &shaders.add("particle sort merge", "shader/vdeferred.glsl", "shader/fparticlesort.glsl");
+		drawShader = &shaders.add("particles", "shader/vparticle.glsl", "shader/fparticle.glsl");
+		sortedDrawShader = &shaders.add("sorted particles", "shader/vparticle.glsl", "shader/fparticle.glsl", { "SORTED" });
+	}
+
+	//step every particle by deltaTime, time seeds the respawns
+	void simulate(float deltaTime, float time)
+	{
+		simulateShader->use();
+		simulateShader->setFloat("deltaTime", deltaTime);
+		simulateShader->setFloat("time", time);
+		simulateShader->setVec3("emitter", emitter);
+		simulateShader->setFloat("lifetime", PARTICLE_LIFETIME);
+		simulateShader->setFloat("speed", PARTICLE_SPEED);
+
+		unsigned int next = 1 - current;
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, states[next]);
+		glBindVertexArray(stateVAOs[current]);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, particles);
+		glEndTransformFeedback();
+		glBindVertexArray(0);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glDisable(GL_RASTERIZER_DISCARD);
+		current = next;
+
+		RenderStats &stats = renderStats();
+		++stats.drawCalls;
+		++stats.vertexArrayBinds;
+	}
+
+	//run the next PARTICLE_SORT_PASSES passes of the sort by distance to viewPos
+	void sort(const glm::vec3 &viewPos)
+	{
+		GLint bound = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glViewport(0, 0, sortWidth, sortHeight);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_BLEND);
+		glBindVertexArray(emptyVAO);
+		glActiveTexture(GL_TEXTURE0);
+
+		for (unsigned int pass = 0; pass < PARTICLE_SORT_PASSES; ++pass)
+		{
+			if (stageSize == 0)
+			{
+				//a new round starts from the keys of the current positions
+				unsigned int target = work[0];
+				glBindFramebuffer(GL_FRAMEBUFFER, orderFBOs[target]);
+				keyShader->use();
+				keyShader->setInt("particles", 0);
+				keyShader->setInt("width", sortWidth);
+				keyShader->setVec3("viewPos", viewPos);
+				glBindTexture(GL_TEXTURE_BUFFER, stateTextures[current]);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+				glBindTexture(GL_TEXTURE_BUFFER, 0);
+				source = target;
+				stageSize = 2;
+				stride = 1;
+				continue;
+			}
+
+			unsigned int target = source == work[0] ? work[1] : work[0];
+			glBindFramebuffer(GL_FRAMEBUFFER, orderFBOs[target]);
+			mergeShader->use();
+			mergeShader->setInt("order", 0);
+			mergeShader->setInt("width", sortWidth);
+			mergeShader->setInt("stageSize", stageSize);
+			mergeShader->setInt("stride", stride);
+			glBindTexture(GL_TEXTURE_2D, orderTextures[source]);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			source = target;
+
+			stride >>= 1;
+			if (stride == 0)
+			{
+				stageSize <<= 1;
+				stride = stageSize >> 1;
+			}
+			if (stageSize > particles)
+			{
+				//finished, draw this order and sort the next one in the other two textures
+				display = source;
+				work[0] = (display + 1) % 3;
+				work[1] = (display + 2) % 3;
+				stageSize = 0;
+				++completedSorts;
+			}
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindVertexArray(0);
+		glEnable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, bound);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		renderStats().drawCalls += PARTICLE_SORT_PASSES;
+	}
+
+	/*
+	*camera facing quads, depth tested but not written, view gives the camera axes
+	*the order is only back to front for the eye of the last sort, sortedView is false for any other eye
+	*and those draw additively, which needs no order
+	*/
+	void draw(const glm::mat4 &viewProjection, const glm::mat4 &view, bool sortedView = true)
+	{
+		bool ordered = sorted && sortedView && display < 3;
+		Shader &shader = ordered ? *sortedDrawShader : *drawShader;
+		shader.use();
+		shader.setMat4("viewProjection", viewProjection);
+		shader.setVec3("cameraRight", glm::vec3(view[0][0], view[1][0], view[2][0]));
+		shader.setVec3("cameraUp", glm::vec3(view[0][1], view[1][1], view[2][1]));
+		shader.setFloat("size", PARTICLE_SIZE);
+		shader.setFloat("lifetime", PARTICLE_LIFETIME);
+		shader.setVec3("color", color);
+		shader.setInt("particles", 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_BUFFER, stateTextures[current]);
+		if (ordered)
+		{
+			shader.setInt("order", 1);
+			shader.setInt("orderWidth", sortWidth);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, orderTextures[display]);
+		}
+
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, ordered ? GL_ONE_MINUS_SRC_ALPHA : GL_ONE);
+		glDepthMask(GL_FALSE);
+		glBindVertexArray(emptyVAO);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, particles);
+		glBindVertexArray(0);
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+
+		if (ordered)
+		{
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE0);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		RenderStats &stats = renderStats();
+		++stats.drawCalls;
+		stats.triangles += particles * 2;
+		++stats.vertexArrayBinds;
+	}
+
+	//simulateMs, sortMs and drawMs are gpu averages of the three steps
+	void report(std::ostream &out, double simulateMs, double sortMs, double drawMs)
+	{
+		//position and velocity are read and written once per step
+		double megabytes = particles * 4.0 * sizeof(glm::vec4) / (1024.0 * 1024.0);
+		out << "particles: " << particles << (sorted ? ", alpha blended back to front" : ", additive") << ", simulate " << simulateMs << " ms ("
+			<< (simulateMs > 0.0 ? megabytes / simulateMs : 0.0) << " MB/ms), ";
+		if (sorted)
+			out << "sort " << sortMs << " ms (" << completedSorts << " sorts of " << sortFrames() << " frames), ";
+		out << "draw " << drawMs << " ms gpu" << std::endl;
+		completedSorts = 0;
+	}
+
+private:
+	unsigned int particles = 0;
+	unsigned int states[2] = {}, stateVAOs[2] = {}, stateTextures[2] = {};
+	unsigned int current = 0;	//state of the last step
+	unsigned int emptyVAO = 0;
+	Shader *simulateShader = nullptr, *keyShader = nullptr, *mergeShader = nullptr, *drawShader = nullptr,
+		*sortedDrawShader = nullptr;
+
+	//(key, index) textures: one holds the order being drawn, the other two ping-pong while sorting
+	unsigned int orderTextures[3] = {}, orderFBOs[3] = {};
+	unsigned int sortWidth = 1, sortHeight = 1;
+	unsigned int display = 3;	//3 until the first sort finished
+	unsigned int work[2] = { 0, 1 };
+	unsigned int source = 0;
+	unsigned int stageSize = 0, stride = 0;	//bitonic stage, 0 before the key pass
+	unsigned int completedSorts = 0;
+
+	unsigned int sortPasses() const
+	{
+		unsigned int log = 0;
+		while ((1u << log) < particles)
+			++log;
+		return log * (log + 1) / 2 + 1;
+	}
+
+	//upwards cone, the same one the simulation respawns into
+	static glm::vec3 randomDirection(unsigned int &seed)
+	{
+		float u = random(seed), v = random(seed);
+		float angle = 6.2831853f * u;
+		float spread = 0.35f * std::sqrt(v);
+		return glm::normalize(glm::vec3(std::cos(angle) * spread, 1.0f, std::sin(angle) * spread));
+	}
+
+	static float random(unsigned int &seed)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) / 16777216.0f;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+using std::vector;
+using std::string;
+
+/*
+*minimal png writer for frame dumps
+*pixels are stored in uncompressed deflate blocks, which every decoder accepts
+*/
+namespace png {
+
+inline uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc = 0)
+{
+	static uint32_t table[256] = { 0 };
+	if (table[1] == 0)
+	{
+		for (uint32_t n = 0; n < 256; ++n)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; ++k)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+inline void putU32(vector<unsigned char> &out, uint32_t value)
+{
+	out.push_back((value >> 24) & 0xff);
+	out.push_back((value >> 16) & 0xff);
+	out.push_back((value >> 8) & 0xff);
+	out.push_back(value & 0xff);
+}
+
+inline void writeChunk(std::ofstream &file, const char *type, const vector<unsigned char> &data)
+{
+	vector<unsigned char> chunk(type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	vector<unsigned char> header;
+	putU32(header, (uint32_t)data.size());
+	vector<unsigned char> footer;
+	putU32(footer, crc32(chunk.data(), chunk.size()));
+	file.write((const char*)header.data(), header.size());
+	file.write((const char*)chunk.data(), chunk.size());
+	file.write((const char*)footer.data(), footer.size());
+}
+
+//rgba rows as returned by glReadPixels (bottom row first), flipVertical turns them upright
+inline bool write(const string &path, int width, int height, const unsigned char *rgba, bool flipVertical = true)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	file.write((const char*)signature, 8);
+
+	vector<unsigned char> header;
+	putU32(header, width);
+	putU32(header, height);
+	header.push_back(8);	//bit depth
+	header.push_back(6);	//rgba
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	writeChunk(file, "IHDR", header);
+
+	//filter type 0 in front of every row
+	size_t rowSize = (size_t)width * 4;
+	vector<unsigned char> raw;
+	raw.reserve((rowSize + 1) * height);
+	for (int y = 0; y < height; ++y)
+	{
+		int row = flipVertical ? height - 1 - y : y;
+		raw.push_back(0);
+		raw.insert(raw.end(), rgba + row * rowSize, rgba + (row + 1) * rowSize);
+	}
+
+	//zlib stream made of stored blocks of at most 65535 bytes
+	vector<unsigned char> zlib = { 0x78, 0x01 };
+	uint32_t a = 1, b = 0;
+	for (size_t offset = 0; offset < raw.size() || offset == 0; )
+	{
+		size_t size = std::min(raw.size() - offset, (size_t)65535);
+		bool last = offset + size >= raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(size & 0xff);
+		zlib.push_back((size >> 8) & 0xff);
+		zlib.push_back(~size & 0xff);
+		zlib.push_back((~size >> 8) & 0xff);
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+		for (size_t i = offset; i < offset + size; ++i)
+		{
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		offset += size;
+		if (last)
+			break;
+	}
+	putU32(zlib, (b << 16) | a);
+	writeChunk(file, "IDAT", zlib);
+	writeChunk(file, "IEND", vector<unsigned char>());
+
+	return (bool)file;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,323 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "model.h"
+#include "animation.h"
+#include "skinning.h"
+#include "jobs.h"
+#include "profiler.h"
+
+#include <vector>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define POSE_SIMD 1
+#endif
+
+using std::vector;
+
+//channels are interpolated in groups of this many lanes
+const unsigned int POSE_LANES = 4;
+
+//keys of one track inside the flattened key arrays of a clip
+struct PoseTrack {
+	unsigned int offset;
+	unsigned int count;
+};
+
+/*
+*one animation with all key values flattened into structure-of-arrays storage
+*every track has at least one key and the channel count is padded to POSE_LANES
+*so the evaluator never branches on missing tracks
+*/
+class PoseClip
+{
+public:
+	float duration = 0.0f;		//in ticks
+	float ticksPerSecond = 25.0f;
+	unsigned int channelCount = 0;
+	vector<int> channelNodes;	//-1 for padding channels
+	vector<int> nodeChannels;	//per model node, -1 when the node keeps its bind transform
+
+	vector<PoseTrack> positionTracks, rotationTracks, scaleTracks;
+	vector<float> positionTimes, rotationTimes, scaleTimes;
+	vector<float> px, py, pz;
+	vector<float> rx, ry, rz, rw;
+	vector<float> sx, sy, sz;
+
+	PoseClip(const Model &model, int animation = 0)
+	{
+		nodeChannels.assign(model.nodes.size(), -1);
+		if (animation >= 0 && animation < (int)model.animations.size())
+		{
+			const Animation &source = model.animations[animation];
+			duration = source.duration;
+			ticksPerSecond = source.ticksPerSecond;
+			for (const AnimationChannel &channel : source.channels)
+				addChannel(channel.node, &channel);
+		}
+		while (channelCount % POSE_LANES != 0)
+			addChannel(-1, nullptr);
+	}
+
+private:
+	void addChannel(int node, const AnimationChannel *channel)
+	{
+		if (node >= 0)
+			nodeChannels[node] = (int)channelCount;
+		channelNodes.push_back(node);
+		++channelCount;
+
+		positionTracks.push_back({ (unsigned int)positionTimes.size(), 0 });
+		if (channel)
+			for (size_t i = 0; i < channel->positions.size(); ++i)
+				addVec3(positionTimes, px, py, pz, channel->positionTimes[i], channel->positions[i]);
+		if (positionTimes.size() == positionTracks.back().offset)
+			addVec3(positionTimes, px, py, pz, 0.0f, glm::vec3(0.0f));
+		positionTracks.back().count = (unsigned int)positionTimes.size() - positionTracks.back().offset;
+
+		rotationTracks.push_back({ (unsigned int)rotationTimes.size(), 0 });
+		if (channel)
+			for (size_t i = 0; i < channel->rotations.size(); ++i)
+				addQuat(channel->rotationTimes[i], channel->rotations[i]);
+		if (rotationTimes.size() == rotationTracks.back().offset)
+			addQuat(0.0f, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		rotationTracks.back().count = (unsigned int)rotationTimes.size() - rotationTracks.back().offset;
+
+		scaleTracks.push_back({ (unsigned int)scaleTimes.size(), 0 });
+		if (channel)
+			for (size_t i = 0; i < channel->scales.size(); ++i)
+				addVec3(scaleTimes, sx, sy, sz, channel->scaleTimes[i], channel->scales[i]);
+		if (scaleTimes.size() == scaleTracks.back().offset)
+			addVec3(scaleTimes, sx, sy, sz, 0.0f, glm::vec3(1.0f));
+		scaleTracks.back().count = (unsigned int)scaleTimes.size() - scaleTracks.back().offset;
+	}
+
+	static void addVec3(vector<float> &times, vector<float> &x, vector<float> &y, vector<float> &z, float time, const glm::vec3 &value)
+	{
+		times.push_back(time);
+		x.push_back(value.x);
+		y.push_back(value.y);
+		z.push_back(value.z);
+	}
+
+	void addQuat(float time, const glm::quat &value)
+	{
+		rotationTimes.push_back(time);
+		rx.push_back(value.x);
+		ry.push_back(value.y);
+		rz.push_back(value.z);
+		rw.push_back(value.w);
+	}
+};
+
+//interpolated local pose of one character, one entry per channel
+struct PoseScratch {
+	vector<float> tx, ty, tz;
+	vector<float> qx, qy, qz, qw;
+	vector<float> sx, sy, sz;
+	vector<glm::mat4> globals;
+};
+
+//out = normalize(a + f * (b - a)) for POSE_LANES quaternions, b is flipped into a's hemisphere
+inline void nlerpLanes(const float a[4][POSE_LANES], const float b[4][POSE_LANES], const float f[POSE_LANES], float *out[4])
+{
+#ifdef POSE_SIMD
+	__m128 ax = _mm_load_ps(a[0]), ay = _mm_load_ps(a[1]), az = _mm_load_ps(a[2]), aw = _mm_load_ps(a[3]);
+	__m128 bx = _mm_load_ps(b[0]), by = _mm_load_ps(b[1]), bz = _mm_load_ps(b[2]), bw = _mm_load_ps(b[3]);
+	__m128 t = _mm_load_ps(f);
+
+	__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+	__m128 sign = _mm_and_ps(dot, _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000)));
+	bx = _mm_xor_ps(bx, sign); by = _mm_xor_ps(by, sign); bz = _mm_xor_ps(bz, sign); bw = _mm_xor_ps(bw, sign);
+
+	__m128 x = _mm_add_ps(ax, _mm_mul_ps(t, _mm_sub_ps(bx, ax)));
+	__m128 y = _mm_add_ps(ay, _mm_mul_ps(t, _mm_sub_ps(by, ay)));
+	__m128 z = _mm_add_ps(az, _mm_mul_ps(t, _mm_sub_ps(bz, az)));
+	__m128 w = _mm_add_ps(aw, _mm_mul_ps(t, _mm_sub_ps(bw, aw)));
+
+	//rsqrt estimate refined by one newton step
+	__m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+	__m128 inv = _mm_rsqrt_ps(length2);
+	inv = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), inv), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(length2, inv), inv)));
+
+	_mm_storeu_ps(out[0], _mm_mul_ps(x, inv));
+	_mm_storeu_ps(out[1], _mm_mul_ps(y, inv));
+	_mm_storeu_ps(out[2], _mm_mul_ps(z, inv));
+	_mm_storeu_ps(out[3], _mm_mul_ps(w, inv));
+#else
+	for (unsigned int lane = 0; lane < POSE_LANES; ++lane)
+	{
+		float dot = a[0][lane] * b[0][lane] + a[1][lane] * b[1][lane] + a[2][lane] * b[2][lane] + a[3][lane] * b[3][lane];
+		float sign = dot < 0.0f ? -1.0f : 1.0f;
+		float q[4];
+		float length2 = 0.0f;
+		for (int c = 0; c < 4; ++c)
+		{
+			q[c] = a[c][lane] + f[lane] * (sign * b[c][lane] - a[c][lane]);
+			length2 += q[c] * q[c];
+		}
+		float inv = 1.0f / std::sqrt(length2);
+		for (int c = 0; c < 4; ++c)
+			out[c][lane] = q[c] * inv;
+	}
+#endif
+}
+
+//out = a + f * (b - a) for POSE_LANES vectors
+inline void lerpLanes(const float a[3][POSE_LANES], const float b[3][POSE_LANES], const float f[POSE_LANES], float *out[3])
+{
+#ifdef POSE_SIMD
+	__m128 t = _mm_load_ps(f);
+	for (int c = 0; c < 3; ++c)
+	{
+		__m128 va = _mm_load_ps(a[c]);
+		_mm_storeu_ps(out[c], _mm_add_ps(va, _mm_mul_ps(t, _mm_sub_ps(_mm_load_ps(b[c]), va))));
+	}
+#else
+	for (int c = 0; c < 3; ++c)
+		for (unsigned int lane = 0; lane < POSE_LANES; ++lane)
+			out[c][lane] = a[c][lane] + f[lane] * (b[c][lane] - a[c][lane]);
+#endif
+}
+
+//surrounding keys of a track at time, the cursor keeps the search incremental
+inline void trackKeys(const PoseTrack &track, const vector<float> &times, float time, unsigned int &cursor,
+	unsigned int &key0, unsigned int &key1, float &factor)
+{
+	if (track.count == 1)
+	{
+		key0 = key1 = track.offset;
+		factor = 0.0f;
+		return;
+	}
+	const float *keyTimes = &times[track.offset];
+	cursor = findKey(keyTimes, track.count, time, cursor);
+	key0 = track.offset + cursor;
+	key1 = track.offset + std::min(cursor + 1, track.count - 1);
+	float span = times[key1] - times[key0];
+	factor = span > 0.0f ? glm::clamp((time - times[key0]) / span, 0.0f, 1.0f) : 0.0f;
+}
+
+/*
+*evaluates the same clip for many characters in parallel
+*each character has its own time and key cursors, bone matrices go straight into a BonePalette
+*/
+class PoseCrowd
+{
+public:
+	PoseCrowd(const Model &model, const PoseClip &clip, unsigned int count, unsigned int workers)
+		:model(&model), clip(&clip), times(count, 0.0f), cursors(count * clip.channelCount * 3, 0), scratch(workers)
+	{
+		for (PoseScratch &s : scratch)
+		{
+			for (vector<float> *v : { &s.tx, &s.ty, &s.tz, &s.qx, &s.qy, &s.qz, &s.qw, &s.sx, &s.sy, &s.sz })
+				v->resize(clip.channelCount);
+			s.globals.resize(model.nodes.size());
+		}
+	}
+
+	unsigned int size() const
+	{
+		return (unsigned int)times.size();
+	}
+
+	void setTime(unsigned int character, float seconds)
+	{
+		times[character] = clip->duration > 0.0f ? std::fmod(seconds * clip->ticksPerSecond, clip->duration) : 0.0f;
+	}
+
+	void update(float deltaTime, JobSystem &jobs, BonePalette &palette)
+	{
+		if (clip->duration > 0.0f)
+			for (float &time : times)
+				time = std::fmod(time + deltaTime * clip->ticksPerSecond, clip->duration);
+
+		jobs.parallelFor(times.size(), 8, [&](size_t begin, size_t end, unsigned int worker) {
+			PROFILE_SCOPE("pose chunk");
+			for (size_t i = begin; i < end; ++i)
+				evaluate((unsigned int)i, scratch[worker], palette.slot((unsigned int)i));
+		});
+	}
+
+	void evaluate(unsigned int character, PoseScratch &s, glm::mat4 *bones)
+	{
+		const PoseClip &c = *clip;
+		float time = times[character];
+		unsigned int *cursor = &cursors[character * c.channelCount * 3];
+
+		for (unsigned int first = 0; first < c.channelCount; first += POSE_LANES)
+		{
+			alignas(16) float a[4][POSE_LANES], b[4][POSE_LANES], f[POSE_LANES];
+			unsigned int key0, key1;
+
+			for (unsigned int lane = 0; lane < POSE_LANES; ++lane)
+			{
+				unsigned int channel = first + lane;
+				trackKeys(c.positionTracks[channel], c.positionTimes, time, cursor[channel * 3], key0, key1, f[lane]);
+				a[0][lane] = c.px[key0]; a[1][lane] = c.py[key0]; a[2][lane] = c.pz[key0];
+				b[0][lane] = c.px[key1]; b[1][lane] = c.py[key1]; b[2][lane] = c.pz[key1];
+			}
+			float *translation[3] = { &s.tx[first], &s.ty[first], &s.tz[first] };
+			lerpLanes(a, b, f, translation);
+
+			for (unsigned int lane = 0; lane < POSE_LANES; ++lane)
+			{
+				unsigned int channel = first + lane;
+				trackKeys(c.rotationTracks[channel], c.rotationTimes, time, cursor[channel * 3 + 1], key0, key1, f[lane]);
+				a[0][lane] = c.rx[key0]; a[1][lane] = c.ry[key0]; a[2][lane] = c.rz[key0]; a[3][lane] = c.rw[key0];
+				b[0][lane] = c.rx[key1]; b[1][lane] = c.ry[key1]; b[2][lane] = c.rz[key1]; b[3][lane] = c.rw[key1];
+			}
+			float *rotation[4] = { &s.qx[first], &s.qy[first], &s.qz[first], &s.qw[first] };
+			nlerpLanes(a, b, f, rotation);
+
+			for (unsigned int lane = 0; lane < POSE_LANES; ++lane)
+			{
+				unsigned int channel = first + lane;
+				trackKeys(c.scaleTracks[channel], c.scaleTimes, time, cursor[channel * 3 + 2], key0, key1, f[lane]);
+				a[0][lane] = c.sx[key0]; a[1][lane] = c.sy[key0]; a[2][lane] = c.sz[key0];
+				b[0][lane] = c.sx[key1]; b[1][lane] = c.sy[key1]; b[2][lane] = c.sz[key1];
+			}
+			float *scale[3] = { &s.sx[first], &s.sy[first], &s.sz[first] };
+			lerpLanes(a, b, f, scale);
+		}
+
+		//nodes are depth-first, parents are always resolved first
+		const vector<ModelNode> &nodes = model->nodes;
+		for (size_t i = 0; i < nodes.size(); ++i)
+		{
+			int channel = c.nodeChannels[i];
+			glm::mat4 local = channel < 0 ? nodes[i].transform : composeLocal(s, channel);
+			s.globals[i] = nodes[i].parent < 0 ? local : s.globals[nodes[i].parent] * local;
+		}
+
+		size_t boneCount = std::min(model->bones.size(), (size_t)MAX_BONES);
+		for (size_t i = 0; i < boneCount; ++i)
+		{
+			const BoneInfo &bone = model->bones[i];
+			bones[i] = bone.node < 0 ? glm::mat4(1.0f) : model->globalInverse * s.globals[bone.node] * bone.offset;
+		}
+	}
+
+private:
+	const Model *model;
+	const PoseClip *clip;
+	vector<float> times;			//per character, in ticks
+	vector<unsigned int> cursors;	//per character, channel and track
+	vector<PoseScratch> scratch;	//per worker
+
+	//translate * rotate * scale without going through glm::translate/rotate/scale
+	static glm::mat4 composeLocal(const PoseScratch &s, int channel)
+	{
+		float x = s.qx[channel], y = s.qy[channel], z = s.qz[channel], w = s.qw[channel];
+		float sx = s.sx[channel], sy = s.sy[channel], sz = s.sz[channel];
+		glm::mat4 m;
+		m[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * sx;
+		m[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * sy;
+		m[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * sz;
+		m[3] = glm::vec4(s.tx[channel], s.ty[channel], s.tz[channel], 1.0f);
+		return m;
+	}
+};
\ No newline at end of file
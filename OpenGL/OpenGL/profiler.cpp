@@ -0,0 +1,235 @@
+#include "profiler.h"
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include <algorithm>
+
+namespace {
+
+struct OpenScope {
+	const char *name;
+	double start;
+};
+
+//written only by its thread, read by Profiler::beginFrame
+struct ThreadRing {
+	ProfileEvent events[PROFILER_RING_SIZE];
+	std::atomic<uint64_t> head{ 0 };
+	uint64_t tail = 0;	//owned by the reader
+	unsigned int thread = 0;
+	OpenScope open[PROFILER_MAX_DEPTH];
+	unsigned int depth = 0;
+};
+
+//rings are never freed, threads may still write to them while the program exits
+std::mutex ringsMutex;
+std::vector<ThreadRing*> rings;
+thread_local ThreadRing *localRing = nullptr;
+
+ThreadRing* threadRing()
+{
+	if (!localRing)
+	{
+		localRing = new ThreadRing();
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		localRing->thread = (unsigned int)rings.size();
+		rings.push_back(localRing);
+	}
+	return localRing;
+}
+
+//copy the new events of every ring, events the writer lapped while copying are dropped
+void drainRings(std::vector<ProfileEvent> &out)
+{
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	for (ThreadRing *ring : rings)
+	{
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		if (head - ring->tail > PROFILER_RING_SIZE)
+			ring->tail = head - PROFILER_RING_SIZE;
+
+		size_t first = out.size();
+		for (uint64_t i = ring->tail; i < head; ++i)
+			out.push_back(ring->events[i & (PROFILER_RING_SIZE - 1)]);
+
+		uint64_t after = ring->head.load(std::memory_order_acquire);
+		if (after - ring->tail > PROFILER_RING_SIZE)
+		{
+			size_t overwritten = (size_t)std::min<uint64_t>(after - ring->tail - PROFILER_RING_SIZE, head - ring->tail);
+			out.erase(out.begin() + first, out.begin() + first + overwritten);
+		}
+		ring->tail = head;
+	}
+}
+
+}
+
+double profileNow()
+{
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void profileBegin(const char *name)
+{
+	ThreadRing *ring = threadRing();
+	if (ring->depth < PROFILER_MAX_DEPTH)
+		ring->open[ring->depth] = { name, profileNow() };
+	++ring->depth;
+}
+
+void profileEnd()
+{
+	ThreadRing *ring = threadRing();
+	if (ring->depth == 0)
+		return;
+	--ring->depth;
+	if (ring->depth >= PROFILER_MAX_DEPTH)
+		return;
+
+	const OpenScope &scope = ring->open[ring->depth];
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	ring->events[head & (PROFILER_RING_SIZE - 1)] = { scope.name, scope.start, profileNow() - scope.start, ring->thread, ring->depth };
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::init()
+{
+	for (GpuFrame &frame : gpuSlots)
+	{
+		glGenQueries(PROFILER_GPU_QUERIES, frame.elapsed);
+		glGenQueries(PROFILER_GPU_QUERIES, frame.stamps);
+	}
+
+	//line up gpu timestamps with the cpu clock
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	gpuOffset = profileNow() - gpuNow / 1000.0;
+	initialized = true;
+}
+
+void Profiler::beginFrame()
+{
+	if (initialized)
+	{
+		currentFrame = (currentFrame + 1) % PROFILER_GPU_FRAMES;
+		resolveGpuFrame(gpuSlots[currentFrame]);
+	}
+
+	drained.clear();
+	drainRings(drained);
+	for (const ProfileEvent &event : drained)
+		cpuTotals[event.name] += event.duration / 1000.0;
+	if (capturing)
+		captured.insert(captured.end(), drained.begin(), drained.end());
+	++frames;
+}
+
+void Profiler::resolveGpuFrame(GpuFrame &frame)
+{
+	//queries finish in order, the last one stands for the frame, the slot is reused either way
+	GLuint available = GL_TRUE;
+	if (frame.count > 0)
+		glGetQueryObjectuiv(frame.elapsed[frame.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		++gpuDropped;
+		frame.count = 0;
+		return;
+	}
+	++gpuFrames;
+	for (unsigned int i = 0; i < frame.count; ++i)
+	{
+		GLuint64 elapsed = 0, stamp = 0;
+		glGetQueryObjectui64v(frame.elapsed[i], GL_QUERY_RESULT, &elapsed);
+		glGetQueryObjectui64v(frame.stamps[i], GL_QUERY_RESULT, &stamp);
+		gpuTotals[frame.names[i]] += elapsed / 1000000.0;
+		if (capturing)
+			captured.push_back({ frame.names[i], stamp / 1000.0 + gpuOffset, elapsed / 1000.0, PROFILER_GPU_THREAD, 0 });
+	}
+	frame.count = 0;
+}
+
+void Profiler::gpuBegin(const char *name)
+{
+	GpuFrame &frame = gpuSlots[currentFrame];
+	if (!initialized || gpuOpen || frame.count >= PROFILER_GPU_QUERIES)
+		return;
+	glQueryCounter(frame.stamps[frame.count], GL_TIMESTAMP);
+	glBeginQuery(GL_TIME_ELAPSED, frame.elapsed[frame.count]);
+	frame.names[frame.count] = name;
+	gpuOpen = true;
+}
+
+void Profiler::gpuEnd()
+{
+	if (!gpuOpen)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	++gpuSlots[currentFrame].count;
+	gpuOpen = false;
+}
+
+void Profiler::startCapture()
+{
+	captured.clear();
+	capturing = true;
+}
+
+bool Profiler::writeChromeTrace(const std::string &path)
+{
+	capturing = false;
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+		return false;
+
+	file << "{\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << PROFILER_GPU_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+	for (const ProfileEvent &event : captured)
+	{
+		file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.thread == PROFILER_GPU_THREAD ? "gpu" : "cpu")
+			<< "\",\"ph\":\"X\",\"ts\":" << event.start << ",\"dur\":" << event.duration
+			<< ",\"pid\":0,\"tid\":" << event.thread << "}";
+	}
+	file << "\n]}\n";
+
+	std::cout << "wrote " << captured.size() << " profile events to " << path << std::endl;
+	captured.clear();
+	return (bool)file;
+}
+
+double Profiler::cpuAverage(const char *name) const
+{
+	auto it = cpuTotals.find(name);
+	return it == cpuTotals.end() || frames == 0 ? 0.0 : it->second / frames;
+}
+
+double Profiler::gpuAverage(const char *name) const
+{
+	auto it = gpuTotals.find(name);
+	return it == gpuTotals.end() || gpuFrames == 0 ? 0.0 : it->second / gpuFrames;
+}
+
+void Profiler::report(std::ostream &out)
+{
+	if (frames == 0)
+		return;
+	out << "profile (ms per frame) cpu:";
+	for (const auto &total : cpuTotals)
+		out << " " << total.first << " " << total.second / frames;
+	out << " | gpu:";
+	for (const auto &total : gpuTotals)
+		out << " " << total.first << " " << total.second / gpuFrames;
+	if (gpuDropped)
+		out << " (" << gpuDropped << " frames still pending, dropped)";
+	out << std::endl;
+
+	cpuTotals.clear();
+	gpuTotals.clear();
+	frames = 0;
+	gpuFrames = 0;
+	gpuDropped = 0;
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+//events kept per thread between two collects, must be a power of two
+const unsigned int PROFILER_RING_SIZE = 4096;
+const unsigned int PROFILER_MAX_DEPTH = 32;
+//frame slots of gpu queries, a slot is read back when it comes round again and dropped if the gpu is still behind
+const unsigned int PROFILER_GPU_FRAMES = 3;
+const unsigned int PROFILER_GPU_QUERIES = 32;
+//thread id used for gpu events in the trace
+const unsigned int PROFILER_GPU_THREAD = 1000;
+
+struct ProfileEvent {
+	const char *name;	//names must outlive the profiler, use string literals
+	double start;		//microseconds since the profiler epoch
+	double duration;
+	unsigned int thread;
+	unsigned int depth;
+};
+
+//microseconds since the first call
+double profileNow();
+
+/*
+*cpu scopes, each thread writes completed scopes into its own ring buffer
+*so recording never takes a lock, registering a new thread does once
+*/
+void profileBegin(const char *name);
+void profileEnd();
+
+class ProfileScope
+{
+public:
+	ProfileScope(const char *name) { profileBegin(name); }
+	~ProfileScope() { profileEnd(); }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+class Profiler
+{
+public:
+	//needs a current gl context
+	void init();
+
+	//reads back the gpu queries of the frame slot about to be reused, if they finished, and drains the cpu rings
+	void beginFrame();
+
+	//GL_TIME_ELAPSED scopes cannot nest, a begin while another one is open is ignored
+	void gpuBegin(const char *name);
+	void gpuEnd();
+
+	//record every event until writeChromeTrace
+	void startCapture();
+	bool isCapturing() const { return capturing; }
+	bool writeChromeTrace(const std::string &path);
+
+	//average time per scope and frame since the last report
+	void report(std::ostream &out);
+	double cpuAverage(const char *name) const;
+	double gpuAverage(const char *name) const;
+
+private:
+	struct GpuFrame {
+		unsigned int elapsed[PROFILER_GPU_QUERIES];
+		unsigned int stamps[PROFILER_GPU_QUERIES];
+		const char *names[PROFILER_GPU_QUERIES];
+		unsigned int count = 0;
+	};
+
+	GpuFrame gpuSlots[PROFILER_GPU_FRAMES];
+	unsigned int currentFrame = 0;
+	bool gpuOpen = false;
+	bool initialized = false;
+	double gpuOffset = 0.0;	//cpu microseconds minus gpu microseconds
+
+	bool capturing = false;
+	std::vector<ProfileEvent> captured;
+	std::vector<ProfileEvent> drained;
+
+	unsigned int frames = 0;
+	unsigned int gpuFrames = 0;	//frames whose queries were read, the gpu averages are over these
+	unsigned int gpuDropped = 0;	//frames whose queries were still pending
+	std::map<std::string, double> cpuTotals;	//milliseconds since the last report
+	std::map<std::string, double> gpuTotals;
+
+	void resolveGpuFrame(GpuFrame &frame);
+};
+
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(Profiler &_profiler, const char *name) :profiler(_profiler) { profiler.gpuBegin(name); }
+	~GpuProfileScope() { profiler.gpuEnd(); }
+
+private:
+	Profiler &profiler;
+};
+
+//cpu and gpu scope with the same name
+#define PROFILE_GPU_SCOPE(profiler, name) PROFILE_SCOPE(name); GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(profiler, name)
\ No newline at end of file
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "glext.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using std::string;
+using std::vector;
+
+/*
+*linked program binaries stored as <directory>/<hash>.bin
+*the key holds the sources and the driver strings, binaries of another driver or source are never loaded
+*file layout: "PBN1", key length, key, binary format, binary length, binary
+*/
+
+inline uint64_t fnv1a(const string &data, uint64_t hash = 14695981039346656037ull)
+{
+	for (unsigned char c : data)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+//driver identity first, the sources are only hashed to keep the stored key short
+inline string programKey(const vector<string> &sources)
+{
+	string key;
+	key += (const char*)glGetString(GL_VENDOR);
+	key += '\n';
+	key += (const char*)glGetString(GL_RENDERER);
+	key += '\n';
+	key += (const char*)glGetString(GL_VERSION);
+	for (const string &source : sources)
+	{
+		char hash[24];
+		snprintf(hash, sizeof(hash), "\n%016llx", (unsigned long long)fnv1a(source));
+		key += hash;
+	}
+	return key;
+}
+
+inline string programCachePath(const string &directory, const string &key)
+{
+	char name[24];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)fnv1a(key));
+	return directory + "/" + name;
+}
+
+//returns a linked program or 0 when there is no valid binary for the key
+inline unsigned int loadProgramBinary(const string &directory, const string &key)
+{
+	const GLExtensions &ext = glExtensions();
+	if (!ext.programBinary)
+		return 0;
+
+	std::ifstream file(programCachePath(directory, key), std::ios::binary);
+	if (!file)
+		return 0;
+
+	char magic[4];
+	uint32_t keyLength = 0, format = 0, length = 0;
+	file.read(magic, 4);
+	file.read((char*)&keyLength, sizeof(keyLength));
+	if (!file || string(magic, 4) != "PBN1" || keyLength != key.size())
+		return 0;
+	string storedKey(keyLength, '\0');
+	file.read(&storedKey[0], keyLength);
+	file.read((char*)&format, sizeof(format));
+	file.read((char*)&length, sizeof(length));
+	if (!file || storedKey != key)
+		return 0;
+	vector<char> binary(length);
+	file.read(binary.data(), length);
+	if (!file)
+		return 0;
+
+	//drivers reject binaries after an update even with the same version string
+	unsigned int program = glCreateProgram();
+	ext.programBinaryLoad(program, format, binary.data(), (GLsizei)length);
+	int success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+inline bool saveProgramBinary(const string &directory, const string &key, unsigned int program)
+{
+	const GLExtensions &ext = glExtensions();
+	if (!ext.programBinary)
+		return false;
+
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	vector<char> binary(length);
+	GLenum format = 0;
+	ext.getProgramBinary(program, length, &length, &format, binary.data());
+
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	std::ofstream file(programCachePath(directory, key), std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+	uint32_t keyLength = (uint32_t)key.size(), storedFormat = format, storedLength = (uint32_t)length;
+	file.write("PBN1", 4);
+	file.write((const char*)&keyLength, sizeof(keyLength));
+	file.write(key.data(), keyLength);
+	file.write((const char*)&storedFormat, sizeof(storedFormat));
+	file.write((const char*)&storedLength, sizeof(storedLength));
+	file.write(binary.data(), length);
+	return (bool)file;
+}
\ No newline at end of file
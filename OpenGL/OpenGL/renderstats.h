@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+*counters of the gl work submitted by the renderer
+*only the thread owning the context draws, so they are plain integers
+*/
+struct RenderStats {
+	unsigned int drawCalls = 0;
+	unsigned int triangles = 0;
+	unsigned int programBinds = 0;
+	unsigned int textureBinds = 0;
+	unsigned int vertexArrayBinds = 0;
+
+	unsigned int stateChanges() const
+	{
+		return programBinds + textureBinds + vertexArrayBinds;
+	}
+};
+
+inline RenderStats& renderStats()
+{
+	static RenderStats stats;
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "model.h"
+#include "transform.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using std::vector;
+using std::string;
+
+struct SceneNode {
+	string name;
+	int parent;					//-1 for roots
+	unsigned int subtreeSize;	//this node and all of its descendants, they follow it in the array
+	glm::mat4 local;
+	glm::mat4 world;
+	Model *model;				//owner of the meshes below, nullptr for pure transforms
+	vector<unsigned int> meshes;
+	vector<unsigned int> lodLevels;	//per mesh, chosen by selectLod
+	bool dirty;
+	ObjectTransform transform;	//world and the shader matrices derived from it
+};
+
+/*
+*nodes are kept in one depth-first array: parents always come before their children
+*and a subtree is the contiguous range [i, i + subtreeSize)
+*so world matrices can be refreshed in a single forward pass
+*note: inserting under an earlier parent shifts the indices of all later nodes
+*/
+class SceneGraph
+{
+public:
+	vector<SceneNode> nodes;
+	LodStats lodStats;
+	unsigned int updatedNodes = 0;	//world matrices recomputed by the last update
+	unsigned int version = 0;		//changes whenever an update moved any node
+	//world bounding sphere of every mesh, in node order, refreshed by sortFrontToBack
+	vector<glm::vec4> meshBounds;
+	//meshes skipped by the last draw with a visibility list
+	unsigned int culledDraws = 0;
+	size_t culledTriangles = 0;
+	//when set the opaque draws skip meshes with an opacity below 1, drawTransparent draws them instead
+	bool transparency = false;
+
+	unsigned int addNode(const string &name, int parent = -1, const glm::mat4 &local = glm::mat4(1.0f))
+	{
+		vector<SceneNode> block;
+		block.push_back(makeNode(name, -1, 1, local));
+		return insertSubtree(parent, block);
+	}
+
+	//instance the node hierarchy of model, returns the root node of the instance
+	unsigned int addModel(Model &model, int parent = -1, const glm::mat4 &local = glm::mat4(1.0f))
+	{
+		vector<SceneNode> block;
+		block.push_back(makeNode(model.directory, -1, (unsigned int)model.nodes.size() + 1, local));
+		for (const ModelNode &modelNode : model.nodes)
+		{
+			SceneNode node = makeNode(modelNode.name, modelNode.parent + 1, modelNode.subtreeSize, modelNode.transform);
+			node.model = &model;
+			node.meshes = modelNode.meshes;
+			node.lodLevels.assign(node.meshes.size(), 0);
+			block.push_back(node);
+		}
+		return insertSubtree(parent, block);
+	}
+
+	void setLocal(unsigned int node, const glm::mat4 &local)
+	{
+		nodes[node].local = local;
+		nodes[node].dirty = true;
+		anyDirty = true;
+	}
+
+	const glm::mat4& world(unsigned int node) const
+	{
+		return nodes[node].world;
+	}
+
+	const ObjectTransform& transform(unsigned int node) const
+	{
+		return nodes[node].transform;
+	}
+
+	//model view projection of every node in one pass, the normal matrices are kept up to date by update
+	void setViewProjection(const glm::mat4 &viewProjection)
+	{
+		for (SceneNode &node : nodes)
+			node.transform.project(viewProjection);
+	}
+
+	//recompute world matrices of dirty nodes and their subtrees, clean nodes are skipped
+	unsigned int update()
+	{
+		updatedNodes = 0;
+		if (!anyDirty)
+			return 0;
+
+		//every node before dirtyEnd lies in the subtree of a node updated in this pass
+		size_t dirtyEnd = 0;
+		for (size_t i = 0; i < nodes.size(); ++i)
+		{
+			SceneNode &node = nodes[i];
+			if (i >= dirtyEnd && !node.dirty)
+				continue;
+
+			node.world = node.parent < 0 ? node.local : nodes[node.parent].world * node.local;
+			node.transform.setModel(node.world);
+			node.dirty = false;
+			dirtyEnd = std::max(dirtyEnd, i + node.subtreeSize);
+			++updatedNodes;
+		}
+		anyDirty = false;
+		++version;
+		return updatedNodes;
+	}
+
+	//fovy is in radians, viewportHeight in pixels
+	void selectLod(const glm::vec3 &viewPos, float fovy, float viewportHeight, float pixelError = 1.0f)
+	{
+		float pixelsPerUnit = viewportHeight / (2.0f * glm::tan(fovy * 0.5f));
+
+		lodStats = LodStats();
+		for (SceneNode &node : nodes)
+			for (size_t i = 0; i < node.meshes.size(); ++i)
+			{
+				const Mesh &mesh = node.model->meshes[node.meshes[i]];
+				node.lodLevels[i] = mesh.selectLod(node.world, viewPos, pixelsPerUnit, pixelError);
+				lodStats.fullTriangles += mesh.triangleCount(0);
+				lodStats.drawnTriangles += mesh.triangleCount(node.lodLevels[i]);
+			}
+	}
+
+	void resetLod()
+	{
+		lodStats = LodStats();
+		for (SceneNode &node : nodes)
+			for (size_t i = 0; i < node.meshes.size(); ++i)
+			{
+				node.lodLevels[i] = 0;
+				lodStats.fullTriangles += node.model->meshes[node.meshes[i]].triangleCount(0);
+			}
+		lodStats.drawnTriangles = lodStats.fullTriangles;
+	}
+
+	/*
+	*every mesh uses the variant its textures need, on top of the features of base
+	*frontToBack draws in the order of the last sortFrontToBack instead of grouped by node
+	*visible, if given, holds one entry per meshBounds sphere and hidden meshes are skipped
+	*/
+	void draw(ShaderVariants &variants, const ShaderPermutation &base = ShaderPermutation(), bool frontToBack = false, const unsigned char *visible = nullptr)
+	{
+		variants.invalidate();
+		culledDraws = 0;
+		culledTriangles = 0;
+		if (frontToBack)
+		{
+			for (const DrawItem &item : drawOrder)
+			{
+				SceneNode &node = nodes[item.node];
+				Mesh &mesh = node.model->meshes[node.meshes[item.mesh]];
+				if (skip(mesh))
+					continue;
+				if (visible && !visible[item.bounds])
+				{
+					cull(mesh, node.lodLevels[item.mesh]);
+					continue;
+				}
+				Shader &shader = variants.use(ShaderPermutation(base.features | mesh.features(), base.pointLights));
+				node.transform.apply(shader);
+				mesh.draw(shader, node.lodLevels[item.mesh]);
+			}
+			return;
+		}
+
+		unsigned int bounds = 0;
+		for (SceneNode &node : nodes)
+		{
+			for (size_t i = 0; i < node.meshes.size(); ++i, ++bounds)
+			{
+				Mesh &mesh = node.model->meshes[node.meshes[i]];
+				if (skip(mesh))
+					continue;
+				if (visible && !visible[bounds])
+				{
+					cull(mesh, node.lodLevels[i]);
+					continue;
+				}
+				Shader &shader = variants.use(ShaderPermutation(base.features | mesh.features(), base.pointLights));
+				node.transform.apply(shader);
+				mesh.draw(shader, node.lodLevels[i]);
+			}
+		}
+	}
+
+	//depth-only pass in the order of the last sortFrontToBack, one variant for every mesh
+	void drawDepth(ShaderVariants &variants, const ShaderPermutation &base, const unsigned char *visible = nullptr)
+	{
+		variants.invalidate();
+		Shader &shader = variants.use(base);
+		unsigned int last = (unsigned int)-1;
+		for (const DrawItem &item : drawOrder)
+		{
+			if (visible && !visible[item.bounds])
+				continue;
+			SceneNode &node = nodes[item.node];
+			Mesh &mesh = node.model->meshes[node.meshes[item.mesh]];
+			if (skip(mesh))
+				continue;
+			if (item.node != last)
+			{
+				node.transform.apply(shader);
+				last = item.node;
+			}
+			mesh.drawDepth(node.lodLevels[item.mesh]);
+		}
+	}
+
+	//depth of every mesh seen from viewProjection, e.g. a shadow cascade, in node order, transparent meshes still cast
+	void drawDepth(ShaderVariants &variants, const ShaderPermutation &base, const glm::mat4 &viewProjection)
+	{
+		variants.invalidate();
+		Shader &shader = variants.use(base);
+		for (SceneNode &node : nodes)
+		{
+			if (node.meshes.empty())
+				continue;
+			shader.setMat4("modelViewProjection", viewProjection * node.world);
+			for (size_t i = 0; i < node.meshes.size(); ++i)
+				node.model->meshes[node.meshes[i]].drawDepth(node.lodLevels[i]);
+		}
+	}
+
+	/*
+	*the meshes the opaque draws skip, with the features of base on top of their own, returns the draws
+	*the transparency pass blends independently of the order, so they are neither sorted nor culled
+	*the nodes are projected with viewProjection here, so every split screen view can draw them
+	*/
+	unsigned int drawTransparent(ShaderVariants &variants, const ShaderPermutation &base, const glm::mat4 &viewProjection)
+	{
+		variants.invalidate();
+		unsigned int draws = 0;
+		for (SceneNode &node : nodes)
+		{
+			for (size_t i = 0; i < node.meshes.size(); ++i)
+			{
+				Mesh &mesh = node.model->meshes[node.meshes[i]];
+				if (!mesh.transparent())
+					continue;
+				Shader &shader = variants.use(ShaderPermutation(base.features | mesh.features(), base.pointLights));
+				ObjectTransform transform = node.transform;
+				transform.project(viewProjection);
+				transform.apply(shader);
+				shader.setFloat("opacity", mesh.opacity);
+				mesh.draw(shader, node.lodLevels[i]);
+				++draws;
+			}
+		}
+		return draws;
+	}
+
+	//nearest bounding sphere first, so early depth testing rejects as many fragments as possible
+	void sortFrontToBack(const glm::vec3 &viewPos)
+	{
+		drawOrder.clear();
+		meshBounds.clear();
+		for (unsigned int n = 0; n < nodes.size(); ++n)
+		{
+			const SceneNode &node = nodes[n];
+			for (unsigned int i = 0; i < node.meshes.size(); ++i)
+			{
+				const Mesh &mesh = node.model->meshes[node.meshes[i]];
+				glm::vec4 sphere = mesh.worldSphere(node.world);
+				glm::vec3 offset = glm::vec3(sphere) - viewPos;
+				drawOrder.push_back({ n, i, (unsigned int)meshBounds.size(), glm::dot(offset, offset) });
+				meshBounds.push_back(sphere);
+			}
+		}
+		std::sort(drawOrder.begin(), drawOrder.end(), [](const DrawItem &a, const DrawItem &b) { return a.distance2 < b.distance2; });
+	}
+
+private:
+	struct DrawItem {
+		unsigned int node;
+		unsigned int mesh;	//index into node.meshes
+		unsigned int bounds;	//index into meshBounds
+		float distance2;
+	};
+
+	bool anyDirty = false;
+	vector<DrawItem> drawOrder;
+
+	bool skip(const Mesh &mesh) const
+	{
+		return transparency && mesh.transparent();
+	}
+
+	void cull(const Mesh &mesh, unsigned int level)
+	{
+		++culledDraws;
+		culledTriangles += mesh.triangleCount(level);
+	}
+
+	static SceneNode makeNode(const string &name, int parent, unsigned int subtreeSize, const glm::mat4 &local)
+	{
+		return { name, parent, subtreeSize, local, glm::mat4(1.0f), nullptr, vector<unsigned int>(), vector<unsigned int>(), true, ObjectTransform() };
+	}
+
+	/*
+	*insert a depth-first block (parents relative to the block, -1 for its root) as the last child of parent
+	*nodes behind the insertion point shift, so their parent indices are fixed up
+	*/
+	unsigned int insertSubtree(int parent, vector<SceneNode> &block)
+	{
+		unsigned int position = parent < 0 ? (unsigned int)nodes.size() : parent + nodes[parent].subtreeSize;
+		unsigned int count = (unsigned int)block.size();
+
+		for (SceneNode &node : block)
+			node.parent = node.parent < 0 ? parent : (int)position + node.parent;
+		for (size_t i = position; i < nodes.size(); ++i)
+			if (nodes[i].parent >= (int)position)
+				nodes[i].parent += count;
+		for (int ancestor = parent; ancestor >= 0; ancestor = nodes[ancestor].parent)
+			nodes[ancestor].subtreeSize += count;
+
+		nodes.insert(nodes.begin() + position, block.begin(), block.end());
+		anyDirty = true;
+		return position;
+	}
+};
\ No newline at end of file
@@ -1,55 +1,252 @@
 #include "shader.h"
+#include "programcache.h"
+#include "glext.h"
 
-Shader::Shader(const char* vertexFilePath, const char* fragmentFilePath)
+#include <algorithm>
+
+Shader::Shader(const char* vertexFilePath, const char* fragmentFilePath, const std::vector<std::string> &defines)
 {
-	//fetch source code from files
-	std::string vertexSource, fragmentSource;
-	std::ifstream vertexFile, fragmentFile;
-	vertexFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fragmentFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	begin(vertexFilePath, fragmentFilePath, defines);
+	finish();
+}
 
+static bool readShaderFile(const std::string &path, std::string &source)
+{
+	std::ifstream file;
+	file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 	try
 	{
-		vertexFile.open(vertexFilePath);
-		fragmentFile.open(fragmentFilePath);
-		std::stringstream vertexStream, fragmentStream;
-		vertexStream << vertexFile.rdbuf();
-		fragmentStream << fragmentFile.rdbuf();
-		vertexFile.close();
-		fragmentFile.close();
-		vertexSource = vertexStream.str();
-		fragmentSource = fragmentStream.str();
+		file.open(path);
+		std::stringstream stream;
+		stream << file.rdbuf();
+		source = stream.str();
+		return true;
 	}
 	catch (std::ifstream::failure e)
 	{
-		std::cout << "failed to read shader file" << std::endl;
+		std::cout << "failed to read shader file " << path << std::endl;
+		return false;
 	}
+}
 
-	const char* vSource = vertexSource.c_str();
-	const char* fSource = fragmentSource.c_str();
-	unsigned int vertex, fragment;
+//copy path into out with its includes expanded, #line keeps compile errors pointing at the right file
+static void expandIncludes(const std::string &path, unsigned int depth, std::vector<std::string> &files, std::string &out)
+{
+	std::string source;
+	if (depth > 16 || !readShaderFile(path, source))
+		return;
+	unsigned int fileIndex = (unsigned int)files.size();
+	files.push_back(path);
+	std::string directory = path.substr(0, path.find_last_of("/") + 1);
+	if (fileIndex > 0)
+		out += "#line 1 " + std::to_string(fileIndex) + "\n";
 
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vSource, NULL);
-	glCompileShader(vertex);
-	checkCompileError(vertex);
+	std::istringstream lines(source);
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(lines, line))
+	{
+		++lineNumber;
+		size_t first = line.find_first_not_of(" \t");
+		if (first == std::string::npos || line.compare(first, 8, "#include") != 0)
+		{
+			out += line + "\n";
+			continue;
+		}
+
+		size_t open = line.find('"', first), close = line.find('"', open + 1);
+		if (open == std::string::npos || close == std::string::npos)
+		{
+			std::cout << path << ":" << lineNumber << " malformed #include" << std::endl;
+			continue;
+		}
+		//every file is included once
+		std::string included = directory + line.substr(open + 1, close - open - 1);
+		if (std::find(files.begin(), files.end(), included) == files.end())
+		{
+			expandIncludes(included, depth + 1, files, out);
+			out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+		}
+	}
+}
 
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fSource, NULL);
-	glCompileShader(fragment);
-	checkCompileError(fragment);
+std::string preprocessShader(const std::string &path, const std::vector<std::string> &defines, std::vector<std::string> *files)
+{
+	std::vector<std::string> included;
+	std::string body;
+	expandIncludes(path, 0, included, body);
+	if (files)
+	{
+		for (const std::string &file : included)
+			if (std::find(files->begin(), files->end(), file) == files->end())
+				files->push_back(file);
+	}
 
-	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
-	glLinkProgram(ID);
-	checkLinkError(ID);
+	//defines go right behind #version, which has to stay the first statement
+	size_t versionEnd = 0;
+	if (body.compare(0, 8, "#version") == 0)
+		versionEnd = body.find('\n') + 1;
+	std::string header = body.substr(0, versionEnd);
+	for (const std::string &define : defines)
+		header += "#define " + define + "\n";
+	if (versionEnd > 0)
+		header += "#line 2 0\n";
+	return header + body.substr(versionEnd);
+}
+
+void Shader::begin(const char* vertexFilePath, const char* fragmentFilePath, const std::vector<std::string> &defines)
+{
+	vertexPath = vertexFilePath;
+	fragmentPath = fragmentFilePath;
+	this->defines = defines;
+
+	//fetch source code from files, resolving includes and adding the feature defines
+	files.clear();
+	std::string vertexSource = preprocessShader(vertexFilePath, defines, &files);
+	std::string fragmentSource = preprocessShader(fragmentFilePath, defines, &files);
+
+	name = std::string(vertexFilePath) + " + " + fragmentFilePath;
+	for (const std::string &define : defines)
+		name += " " + define;
+	submitted = std::chrono::steady_clock::now();
+
+	//reuse the linked program of an earlier run when sources and driver are unchanged
+	cacheKey = programCacheKey(vertexSource, fragmentSource, feedbackVaryings);
+	ID = loadProgramBinary(SHADER_CACHE_DIRECTORY, cacheKey);
+	fromCache = ID != 0;
+	if (!fromCache)
+		ID = compileProgram(vertexSource, fragmentSource, feedbackVaryings, vertexShader, fragmentShader);
+	pending = true;
+	loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitted).count();
+}
+
+bool Shader::isReady() const
+{
+	if (!pending || fromCache || !glExtensions().parallelShaderCompile)
+		return true;
+	int complete = 0;
+	glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete != 0;
+}
+
+void Shader::finish()
+{
+	if (!pending)
+		return;
+	pending = false;
+
+	//the first status query blocks until the driver is done
+	auto start = std::chrono::steady_clock::now();
+	if (!fromCache)
+	{
+		checkCompileError(vertexShader);
+		checkCompileError(fragmentShader);
+		if (checkLinkError(ID))
+			saveProgramBinary(SHADER_CACHE_DIRECTORY, cacheKey, ID);
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		vertexShader = fragmentShader = 0;
+	}
+	auto end = std::chrono::steady_clock::now();
+	double waitMs = std::chrono::duration<double, std::milli>(end - start).count();
+	loadMs += waitMs;
+	std::cout << name << (fromCache ? " loaded from cache in " : " compiled in ") << loadMs << " ms ("
+		<< std::chrono::duration<double, std::milli>(end - submitted).count() << " ms after submit)" << std::endl;
+}
 
+unsigned int Shader::rebuild(std::vector<std::string> &files) const
+{
+	files.clear();
+	std::string vertexSource = preprocessShader(vertexPath, defines, &files);
+	std::string fragmentSource = preprocessShader(fragmentPath, defines, &files);
+	unsigned int vertex, fragment;
+	unsigned int program = compileProgram(vertexSource, fragmentSource, feedbackVaryings, vertex, fragment);
+	bool compiled = checkCompileError(vertex) & checkCompileError(fragment);
+	bool linked = checkLinkError(program);
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
+	if (!compiled || !linked)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+	saveProgramBinary(SHADER_CACHE_DIRECTORY, programCacheKey(vertexSource, fragmentSource, feedbackVaryings), program);
+	return program;
+}
+
+void Shader::publishReloaded(unsigned int program)
+{
+	//a program published earlier but never swapped in is dropped
+	unsigned int previous = reloaded.exchange(program, std::memory_order_acq_rel);
+	if (previous)
+		glDeleteProgram(previous);
+}
+
+bool Shader::swapReloaded()
+{
+	if (!reloaded.load(std::memory_order_relaxed))
+		return false;
+	unsigned int program = reloaded.exchange(0, std::memory_order_acq_rel);
+	if (!program)
+		return false;
+	glDeleteProgram(ID);
+	ID = program;
+	for (const auto &block : blockBindings)
+	{
+		unsigned int index = glGetUniformBlockIndex(ID, block.first.c_str());
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, index, block.second);
+	}
+	return true;
+}
+
+//only submits the work, errors are checked in finish so the driver can compile in the background
+unsigned int Shader::compileProgram(const std::string &vertexSource, const std::string &fragmentSource,
+	const std::vector<std::string> &varyings, unsigned int &vertexShader, unsigned int &fragmentShader)
+{
+	const char* vSource = vertexSource.c_str();
+	const char* fSource = fragmentSource.c_str();
+
+	vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertexShader, 1, &vSource, NULL);
+	glCompileShader(vertexShader);
+
+	fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragmentShader, 1, &fSource, NULL);
+	glCompileShader(fragmentShader);
+
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	if (!varyings.empty())
+	{
+		std::vector<const char*> names;
+		for (const std::string &varying : varyings)
+			names.push_back(varying.c_str());
+		glTransformFeedbackVaryings(program, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+	}
+	//must be set before linking or the driver may not keep the binary around
+	if (glExtensions().programBinary)
+		glExtensions().programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
+	return program;
+}
+
+std::string Shader::programCacheKey(const std::string &vertexSource, const std::string &fragmentSource,
+	const std::vector<std::string> &varyings)
+{
+	std::vector<std::string> sources = { vertexSource, fragmentSource };
+	if (!varyings.empty())
+	{
+		std::string list = "feedback";
+		for (const std::string &varying : varyings)
+			list += " " + varying;
+		sources.push_back(list);
+	}
+	return programKey(sources);
 }
 
-void Shader::checkCompileError(unsigned int shader)
+bool Shader::checkCompileError(unsigned int shader)
 {
 	int success;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
@@ -61,9 +258,10 @@ void Shader::checkCompileError(unsigned int shader)
 		std::cout << "compile error: " << infoLog <<
 			"\n -------------------------" << std::endl;
 	}
+	return success != 0;
 }
 
-void Shader::checkLinkError(unsigned int program)
+bool Shader::checkLinkError(unsigned int program)
 {
 	int success;
 	glGetProgramiv(program, GL_LINK_STATUS, &success);
@@ -75,4 +273,5 @@ void Shader::checkLinkError(unsigned int program)
 		std::cout << "link error: " << infoLog <<
 			"\n -------------------------" << std::endl;
 	}
+	return success != 0;
 }
\ No newline at end of file
@@ -5,21 +5,68 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "renderstats.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <vector>
+#include <atomic>
+
+//linked programs are stored here, keyed by their sources and the driver
+const char *const SHADER_CACHE_DIRECTORY = "shader/cache";
+
+/*
+*source of a glsl file with #include "file" (relative to the including file) expanded
+*defines are "NAME" or "NAME VALUE" and are inserted after #version, files receives every file read
+*/
+std::string preprocessShader(const std::string &path, const std::vector<std::string> &defines = std::vector<std::string>(),
+	std::vector<std::string> *files = nullptr);
 
 class Shader
 {
 public:
-	unsigned int ID;
+	unsigned int ID = 0;
+	bool fromCache = false;	//linked program was restored from the binary cache
+	double loadMs = 0.0;	//time the calling thread spent reading, compiling and linking
+	//vertex outputs captured with transform feedback (interleaved), must be set before begin
+	std::vector<std::string> feedbackVaryings;
 
 	//generate shader program with specified shader files
-	Shader(const char* vertexFilePath, const char* fragmentFilePath);
+	Shader(const char* vertexFilePath, const char* fragmentFilePath, const std::vector<std::string> &defines = std::vector<std::string>());
+	Shader() {}
+
+	/*
+	*split construction, begin submits the compile and link without reading any status
+	*so the driver can work in the background until finish checks the result
+	*/
+	void begin(const char* vertexFilePath, const char* fragmentFilePath, const std::vector<std::string> &defines = std::vector<std::string>());
+	//never blocks with KHR_parallel_shader_compile, always true without it
+	bool isReady() const;
+	void finish();
 
 	//activate the shader program
-	void use() { glUseProgram(ID); }
+	void use()
+	{
+		glUseProgram(ID);
+		++renderStats().programBinds;
+	}
+
+	/*
+	*compile and link the current files again without touching ID, 0 when they do not compile
+	*used by ShaderReloader on its own context, the result is handed over with publishReloaded
+	*files receives the files read, includes may have changed
+	*/
+	unsigned int rebuild(std::vector<std::string> &files) const;
+	void publishReloaded(unsigned int program);
+	//replace ID by a program published with publishReloaded, returns whether it did
+	//call between frames, the uniforms set on the old program are not carried over
+	bool swapReloaded();
+	//files the program was built from, includes too
+	const std::vector<std::string>& sourceFiles() const { return files; }
+	const std::string& displayName() const { return name; }
 
 	void setBool(const std::string &name, bool value) const
 	{
@@ -51,14 +98,53 @@ public:
 		setVec3(name, vec.x, vec.y, vec.z);
 	}
 
+	void setMat3(const std::string &name, const glm::mat3 &data)
+	{
+		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(data));
+	}
+
 	void setMat4(const std::string &name, glm::mat4 data)
 	{
 		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(data));
 	}
 
+	//attach the uniform block to a buffer binding point, reapplied to reloaded programs
+	void setBlockBinding(const std::string &name, unsigned int binding)
+	{
+		unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, index, binding);
+		for (auto &block : blockBindings)
+		{
+			if (block.first == name)
+			{
+				block.second = binding;
+				return;
+			}
+		}
+		blockBindings.push_back({ name, binding });
+	}
+
 
 private:
+	std::string name;
+	std::string cacheKey;
+	std::string vertexPath, fragmentPath;
+	std::vector<std::string> defines;
+	std::vector<std::string> files;
+	std::vector<std::pair<std::string, unsigned int>> blockBindings;
+	unsigned int vertexShader = 0, fragmentShader = 0;
+	bool pending = false;
+	std::chrono::steady_clock::time_point submitted;
+	std::atomic<unsigned int> reloaded{ 0 };
+
+	static unsigned int compileProgram(const std::string &vertexSource, const std::string &fragmentSource,
+		const std::vector<std::string> &varyings, unsigned int &vertexShader, unsigned int &fragmentShader);
+	//the captured varyings are linked into the binary, so they are part of the cache key
+	static std::string programCacheKey(const std::string &vertexSource, const std::string &fragmentSource,
+		const std::vector<std::string> &varyings);
+
 	//check shader compilation/linking errors
-	void checkCompileError(unsigned int shader);
-	void checkLinkError(unsigned int program);
+	static bool checkCompileError(unsigned int shader);
+	static bool checkLinkError(unsigned int program);
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+//clustered lights, filled every frame by ClusteredLights (clusters.h)
+
+uniform samplerBuffer clusterLights;     //3 texels per light: position range, color cosInner, direction cosOuter
+uniform usamplerBuffer clusterRanges;    //offset and count into clusterIndices per cluster
+uniform usamplerBuffer clusterIndices;
+uniform ivec3 clusterGrid;
+uniform vec2 clusterTileSize;            //1 / tile size in pixels
+uniform vec2 clusterDepth;               //slice = log(depth) * x + y
+
+uniform mat4 view;
+
+int clusterIndex(float depth)
+{
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileSize), clusterGrid.xy - 1);
+    int slice = clamp(int(log(depth) * clusterDepth.x + clusterDepth.y), 0, clusterGrid.z - 1);
+    return (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x;
+}
+
+vec3 calcClusterLight(int light, vec3 normal, vec3 viewDir, vec3 fragPos, float shininess, vec3 albedo, vec3 specularColor)
+{
+    vec4 positionRange = texelFetch(clusterLights, light * 3);
+    vec4 colorInner = texelFetch(clusterLights, light * 3 + 1);
+    vec4 directionOuter = texelFetch(clusterLights, light * 3 + 2);
+
+    vec3 toLight = positionRange.xyz - fragPos;
+    float dis = length(toLight);
+    vec3 lightDir = toLight / max(dis, 0.0001);
+
+    //falls to zero at the range so lights outside a cluster are never missed
+    float window = clamp(1.0 - pow(dis / positionRange.w, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (1.0 + dis * dis);
+
+    //point lights have cosOuter below -1
+    if (directionOuter.w > -1.0)
+    {
+        float theta = dot(lightDir, -directionOuter.xyz);
+        attenuation *= clamp((theta - directionOuter.w) / max(colorInner.w - directionOuter.w, 0.0001), 0.0, 1.0);
+    }
+    if (attenuation <= 0.0)
+        return vec3(0.0);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+
+    return colorInner.rgb * (diff * albedo + spec * specularColor) * attenuation;
+}
+
+vec3 calcClusterLights(vec3 normal, vec3 viewDir, vec3 fragPos, float shininess, vec3 albedo, vec3 specularColor)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    uvec2 range = texelFetch(clusterRanges, clusterIndex(depth)).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; ++i)
+    {
+        int light = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        result += calcClusterLight(light, normal, viewDir, fragPos, shininess, albedo, specularColor);
+    }
+    return result;
+}
\ No newline at end of file
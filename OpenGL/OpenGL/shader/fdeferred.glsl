@@ -0,0 +1,64 @@
+#version 330 core
+
+//lighting passes of the deferred path, see vdeferred.glsl
+//SHADOWS   cascaded shadow maps in the directional pass
+
+#include "lights.glsl"
+#include "clusters.glsl"
+#include "octahedral.glsl"
+#ifdef SHADOWS
+#include "shadows.glsl"
+#endif
+
+out vec4 FragColor;
+
+#ifdef LIGHT_VOLUME
+flat in int Light;
+#endif
+
+struct Material{
+    float shininess;
+};
+
+uniform Material material;
+
+uniform vec3 viewPos;
+uniform mat4 inverseViewProjection;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+#ifndef LIGHT_VOLUME
+uniform DirLight dirLight;
+#endif
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    //background
+    if (depth == 1.0)
+        discard;
+
+    vec2 uv = gl_FragCoord.xy / vec2(textureSize(gDepth, 0));
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = world.xyz / world.w;
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec3 normDir = decodeNormal(texelFetch(gNormal, pixel, 0).rg);
+    vec3 viewDir = normalize(viewPos - fragPos);
+    vec3 specularColor = vec3(albedoSpecular.a);
+
+#ifdef LIGHT_VOLUME
+    vec3 result = calcClusterLight(Light, normDir, viewDir, fragPos, material.shininess, albedoSpecular.rgb, specularColor);
+#else
+#ifdef SHADOWS
+    float shadow = calcShadow(fragPos, normDir);
+#else
+    float shadow = 1.0;
+#endif
+    vec3 result = calcDirLight(dirLight, normDir, viewDir, material.shininess, albedoSpecular.rgb, specularColor, shadow);
+#endif
+    FragColor = vec4(result, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,7 @@
+#version 330 core
+
+//depth pre-pass, only the depth written by vmodel.glsl (DEPTH_ONLY) matters
+
+void main()
+{
+}
\ No newline at end of file
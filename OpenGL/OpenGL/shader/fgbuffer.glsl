@@ -0,0 +1,56 @@
+#version 330 core
+
+/*
+*geometry pass of the deferred path, writes the surface instead of shading it
+*same permutations as fmodel.glsl, the light counts do not matter here
+*gAlbedoSpecular  rgb albedo, a specular intensity (RGBA8)
+*gNormal          octahedral world space normal (RG16)
+*/
+
+#include "octahedral.glsl"
+
+layout(location = 0) out vec4 gAlbedoSpecular;
+layout(location = 1) out vec2 gNormal;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoord;
+in vec3 Color;
+#ifdef NORMAL_MAP
+in mat3 TBN;
+#endif
+
+#ifdef TEXTURED
+uniform sampler2D texture_diffuse1;
+#ifdef SPECULAR_MAP
+uniform sampler2D texture_specular1;
+#endif
+#endif
+#ifdef NORMAL_MAP
+uniform sampler2D texture_normal1;
+#endif
+
+void main()
+{
+#ifdef NORMAL_MAP
+    vec3 normDir = normalize(TBN * (texture(texture_normal1, TexCoord).rgb * 2.0 - 1.0));
+#else
+    vec3 normDir = normalize(Normal);
+#endif
+
+#ifdef TEXTURED
+    vec3 albedo = vec3(texture(texture_diffuse1, TexCoord));
+#ifdef SPECULAR_MAP
+    vec3 specularColor = vec3(texture(texture_specular1, TexCoord));
+#else
+    vec3 specularColor = albedo;
+#endif
+#else
+    vec3 albedo = Color;
+    vec3 specularColor = Color;
+#endif
+
+    //specular color is reduced to its luminance to fit the alpha channel
+    gAlbedoSpecular = vec4(albedo, dot(specularColor, vec3(0.299, 0.587, 0.114)));
+    gNormal = encodeNormal(normDir);
+}
\ No newline at end of file
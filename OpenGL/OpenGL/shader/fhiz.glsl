@@ -0,0 +1,19 @@
+#version 330 core
+
+//one level of the hi-z pyramid: the farthest depth of the source texels under this texel
+//the third row and column cover odd source sizes, at worst the result is a little more conservative
+
+uniform sampler2D source;
+
+out float Depth;
+
+void main()
+{
+    ivec2 size = textureSize(source, 0);
+    ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+    float depth = 0.0;
+    for (int y = 0; y < 3; ++y)
+        for (int x = 0; x < 3; ++x)
+            depth = max(depth, texelFetch(source, min(base + ivec2(x, y), size - 1), 0).r);
+    Depth = depth;
+}
\ No newline at end of file
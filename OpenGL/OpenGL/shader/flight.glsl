@@ -1,5 +1,7 @@
 #version 330 core
 
+#include "lights.glsl"
+
 in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoord;
@@ -13,43 +15,6 @@ struct Material{
     float shininess;
 };
 
-struct DirLight{
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight{
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-//should extend PointLight
-struct SpotLight{
-    vec3 position;
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    float cutoff;
-    float outerCutoff;
-};
-
 uniform vec3 viewPos;
 
 uniform Material material;
@@ -57,86 +22,19 @@ uniform DirLight dirLight;
 uniform PointLight pointLight;
 uniform SpotLight spotLight;
 
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 viewDir, vec3 fragPos);
-vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, vec3 fragPos);
-
 void main()
 {
     vec3 normDir = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
 
-    vec3 result = calcDirLight(dirLight, normDir, viewDir);
-    result += calcPointLight(pointLight, normDir, viewDir, FragPos);
-    result += calcSpotLight(spotLight, normDir, viewDir, FragPos);
+    vec3 albedo = vec3(texture(material.diffuse, TexCoord));
+    vec3 specularColor = vec3(texture(material.specular, TexCoord));
+
+    vec3 result = calcDirLight(dirLight, normDir, viewDir, material.shininess, albedo, specularColor);
+    result += calcPointLight(pointLight, normDir, viewDir, FragPos, material.shininess, albedo, specularColor);
+    result += calcSpotLight(spotLight, normDir, viewDir, FragPos, material.shininess, albedo, specularColor);
 
     vec3 emission = vec3(texture(material.emission, TexCoord));
 
     FragColor = vec4(result + emission, 1.0);
-}
-
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-    vec3 lightDir = normalize(-light.direction);
-
-    float diff = max(dot(normal, lightDir), 0.0);
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoord));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoord));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoord));
-
-    return (ambient + diffuse + specular);
-}
-
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 viewDir, vec3 fragPos)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-
-    float diff = max(dot(normal, lightDir), 0.0);
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    float dis = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * dis + light.quadratic * dis * dis);
-
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoord));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoord));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoord));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    return (ambient + diffuse + specular);
-}
-
-vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, vec3 fragPos)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    float theta = dot(lightDir, normalize(-light.direction));
-    float epsilon = spotLight.cutoff - spotLight.outerCutoff;
-    float intensity = clamp((theta - spotLight.outerCutoff) / epsilon, 0.0, 1.0);
-    if(intensity < 0.001)
-        return vec3(0.0);
-    
-    float diff = max(dot(normal, lightDir), 0.0);
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    float dis = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * dis + light.quadratic * dis * dis);
-
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoord));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoord));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoord));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    return intensity * (ambient + diffuse + specular);
-    
 }
\ No newline at end of file
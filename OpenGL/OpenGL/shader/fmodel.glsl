@@ -1,173 +1,112 @@
 #version 330 core
 
+/*
+*permutations, see ShaderVariants
+*TEXTURED        diffuse (and SPECULAR_MAP) textures instead of the vertex color
+*NORMAL_MAP      tangent space normals from texture_normal1
+*POINT_LIGHTS n  number of point lights, 1 when not defined
+*CLUSTERED       point and spot lights from the clustered light lists instead of the uniforms
+*SHADOWS         cascaded shadow maps of the directional light
+*TRANSPARENT     weighted blended transparency with the material opacity, see WeightedBlendedOIT
+*/
+#ifndef POINT_LIGHTS
+#define POINT_LIGHTS 1
+#endif
+
+#include "lights.glsl"
+#ifdef CLUSTERED
+#include "clusters.glsl"
+#endif
+#ifdef SHADOWS
+#include "shadows.glsl"
+#endif
+
+#ifdef TRANSPARENT
+layout(location = 0) out vec4 Accumulation;
+layout(location = 1) out float Coverage;
+
+uniform float opacity;
+#else
 out vec4 FragColor;
+#endif
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoord;
 in vec3 Color;
+#ifdef NORMAL_MAP
+in mat3 TBN;
+#endif
 
 struct Material{
     float shininess;
 };
 
-struct DirLight{
-    vec3 direction;
-
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight{
-    vec3 position;
-
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-//should extend PointLight
-struct SpotLight{
-    vec3 position;
-    vec3 direction;
-
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    float cutoff;
-    float outerCutoff;
-};
-
 uniform Material material;
 
 uniform vec3 viewPos;
 
 uniform DirLight dirLight;
-uniform PointLight pointLight;
+#if POINT_LIGHTS > 0
+uniform PointLight pointLights[POINT_LIGHTS];
+#endif
+#ifndef CLUSTERED
 uniform SpotLight spotLight;
+#endif
 
+#ifdef TEXTURED
 uniform sampler2D texture_diffuse1;
+#ifdef SPECULAR_MAP
 uniform sampler2D texture_specular1;
-uniform sampler2D texture_emission1;
-
-uniform bool useTexture;
-
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 viewDir, vec3 fragPos);
-vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, vec3 fragPos);
+#endif
+#endif
+#ifdef NORMAL_MAP
+uniform sampler2D texture_normal1;
+#endif
 
 void main()
 {
+#ifdef NORMAL_MAP
+    vec3 normDir = normalize(TBN * (texture(texture_normal1, TexCoord).rgb * 2.0 - 1.0));
+#else
     vec3 normDir = normalize(Normal);
+#endif
     vec3 viewDir = normalize(viewPos - FragPos);
 
-    vec3 result = calcDirLight(dirLight, normDir, viewDir);
-    result += calcPointLight(pointLight, normDir, viewDir, FragPos);
-    result += calcSpotLight(spotLight, normDir, viewDir, FragPos);
-
-    vec3 emission;
-    if (useTexture)
-        emission = vec3(texture(texture_emission1, TexCoord));
-    else
-        emission = vec3(0.0);
-
-    FragColor = vec4(result + emission, 1.0);
-}
-
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-    vec3 lightDir = normalize(-light.direction);
-
-    float diff = max(dot(normal, lightDir), 0.0);
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    vec3 diffuse = light.diffuse * diff;
-    vec3 specular = light.specular * spec;
-    if (useTexture)
-    {
-        diffuse *= vec3(texture(texture_diffuse1, TexCoord));
-        specular *= vec3(texture(texture_specular1, TexCoord));
-    }
-    else
-    {
-        diffuse *= Color;
-        specular *= Color;
-    }
-
-    return (diffuse + specular);
-}
-
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 viewDir, vec3 fragPos)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-
-    float diff = max(dot(normal, lightDir), 0.0);
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    float dis = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * dis + light.quadratic * dis * dis);
-
-    vec3 diffuse = light.diffuse * diff;
-    vec3 specular = light.specular * spec;
-    if (useTexture)
-    {
-        diffuse *= vec3(texture(texture_diffuse1, TexCoord));
-        specular *= vec3(texture(texture_specular1, TexCoord));
-    }
-    else
-    {
-        diffuse *= Color;
-        specular *= Color;
-    }
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    return (diffuse + specular);
-}
-
-vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, vec3 fragPos)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    float theta = dot(lightDir, normalize(-light.direction));
-    float epsilon = spotLight.cutoff - spotLight.outerCutoff;
-    float intensity = clamp((theta - spotLight.outerCutoff) / epsilon, 0.0, 1.0);
-    if(intensity < 0.001)
-        return vec3(0.0);
-    
-    float diff = max(dot(normal, lightDir), 0.0);
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    float dis = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * dis + light.quadratic * dis * dis);
-
-    vec3 diffuse = light.diffuse * diff;
-    vec3 specular = light.specular * spec;
-    if (useTexture)
-    {
-        diffuse *= vec3(texture(texture_diffuse1, TexCoord));
-        specular *= vec3(texture(texture_specular1, TexCoord));
-    }
-    else
-    {
-        diffuse *= Color;
-        specular *= Color;
-    }
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    return intensity * (diffuse + specular);
-    
+#ifdef TEXTURED
+    vec3 albedo = vec3(texture(texture_diffuse1, TexCoord));
+#ifdef SPECULAR_MAP
+    vec3 specularColor = vec3(texture(texture_specular1, TexCoord));
+#else
+    vec3 specularColor = albedo;
+#endif
+#else
+    vec3 albedo = Color;
+    vec3 specularColor = Color;
+#endif
+
+#ifdef SHADOWS
+    float shadow = calcShadow(FragPos, normalize(Normal));
+#else
+    float shadow = 1.0;
+#endif
+    vec3 result = calcDirLight(dirLight, normDir, viewDir, material.shininess, albedo, specularColor, shadow);
+#if POINT_LIGHTS > 0
+    for (int i = 0; i < POINT_LIGHTS; ++i)
+        result += calcPointLight(pointLights[i], normDir, viewDir, FragPos, material.shininess, albedo, specularColor);
+#endif
+#ifdef CLUSTERED
+    result += calcClusterLights(normDir, viewDir, FragPos, material.shininess, albedo, specularColor);
+#else
+    result += calcSpotLight(spotLight, normDir, viewDir, FragPos, material.shininess, albedo, specularColor);
+#endif
+
+#ifdef TRANSPARENT
+    //McGuire and Bavoil, equation 10: nearer surfaces dominate the average, the depth is not linear so it is cubed
+    float weight = clamp(3e3 * pow(1.0 - gl_FragCoord.z, 3.0), 1e-2, 3e3);
+    Accumulation = vec4(result * opacity * weight, opacity);
+    Coverage = opacity * weight;
+#else
+    FragColor = vec4(result, 1.0);
+#endif
 }
\ No newline at end of file
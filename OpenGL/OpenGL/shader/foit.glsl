@@ -0,0 +1,22 @@
+#version 330 core
+
+//composite of the weighted blended transparency over the opaque image, see WeightedBlendedOIT
+
+uniform sampler2D accumulation;    //rgb weighted premultiplied colour, a revealage
+uniform sampler2D coverage;        //weighted alpha
+
+out vec4 FragColor;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 sum = texelFetch(accumulation, texel, 0);
+    float revealage = sum.a;
+    //no transparent surface here, the opaque colour stays
+    if (revealage >= 1.0)
+        discard;
+    float weight = texelFetch(coverage, texel, 0).r;
+    //many near layers can overflow half floats, their average is then taken as white
+    vec3 average = any(isinf(sum.rgb)) ? vec3(1.0) : sum.rgb / max(weight, 1e-5);
+    FragColor = vec4(average, 1.0 - revealage);
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#version 330 core
+
+//round soft sprite that cools down and fades out with age
+
+in vec2 Corner;
+in float Age;
+
+uniform vec3 color;
+
+out vec4 FragColor;
+
+void main()
+{
+    float r2 = dot(Corner, Corner);
+    if (r2 > 1.0)
+        discard;
+    vec3 hot = mix(vec3(1.0, 0.95, 0.8), color, min(Age * 2.0, 1.0));
+    FragColor = vec4(hot * (1.0 - Age * 0.7), (1.0 - r2) * (1.0 - Age));
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#version 330 core
+
+/*
+*sort passes of the particles, one texel per particle in a width wide rg32f texture
+*KEYS        (distance key, particle index) of the current state, the farthest particle has the smallest key
+*default     one bitonic compare and exchange step: stageSize is the size of the sequences being merged,
+*            stride the distance between the compared texels
+*/
+
+uniform int width;
+
+out vec2 Order;
+
+#ifdef KEYS
+uniform samplerBuffer particles;    //2 texels per particle: position life, velocity seed
+uniform vec3 viewPos;
+
+void main()
+{
+    int i = int(gl_FragCoord.y) * width + int(gl_FragCoord.x);
+    vec4 positionLife = texelFetch(particles, i * 2);
+    //expired particles go last, they are not drawn anyway
+    float key = positionLife.w > 0.0 ? -distance(positionLife.xyz, viewPos) : 1e30;
+    Order = vec2(key, float(i));
+}
+#else
+uniform sampler2D order;
+uniform int stageSize;
+uniform int stride;
+
+void main()
+{
+    int i = int(gl_FragCoord.y) * width + int(gl_FragCoord.x);
+    int partner = i ^ stride;
+    vec2 self = texelFetch(order, ivec2(gl_FragCoord.xy), 0).xy;
+    vec2 other = texelFetch(order, ivec2(partner % width, partner / width), 0).xy;
+    //ties are broken by index so both texels of a pair agree
+    bool otherFirst = other.x < self.x || (other.x == self.x && other.y < self.y);
+    bool ascending = (i & stageSize) == 0;
+    bool lower = i < partner;
+    //the lower texel of an ascending pair keeps the smaller key, the upper one the larger
+    Order = (lower == ascending) == otherFirst ? other : self;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,103 @@
+//light types shared by the lit shaders, surface colors are passed in so callers decide where they come from
+
+struct DirLight{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight{
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+//should extend PointLight
+struct SpotLight{
+    vec3 position;
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    float cutoff;
+    float outerCutoff;
+};
+
+//shadow scales the diffuse and specular terms, the ambient term is always there
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shininess, vec3 albedo, vec3 specularColor, float shadow)
+{
+    vec3 lightDir = normalize(-light.direction);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+
+    return ambient + shadow * (diffuse + specular);
+}
+
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shininess, vec3 albedo, vec3 specularColor)
+{
+    return calcDirLight(light, normal, viewDir, shininess, albedo, specularColor, 1.0);
+}
+
+vec3 calcPointLight(PointLight light, vec3 normal, vec3 viewDir, vec3 fragPos, float shininess, vec3 albedo, vec3 specularColor)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+
+    float dis = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * dis + light.quadratic * dis * dis);
+
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, vec3 fragPos, float shininess, vec3 albedo, vec3 specularColor)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutoff - light.outerCutoff;
+    float intensity = clamp((theta - light.outerCutoff) / epsilon, 0.0, 1.0);
+    if(intensity < 0.001)
+        return vec3(0.0);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+
+    float dis = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * dis + light.quadratic * dis * dis);
+
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+
+    return intensity * attenuation * (ambient + diffuse + specular);
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+//cascaded shadow map of the directional light, filled by CascadedShadows (shadows.h)
+
+#define SHADOW_CASCADES 4
+
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[SHADOW_CASCADES];    //world to shadow map coordinates and depth
+uniform vec4 cascadeSpheres[SHADOW_CASCADES];    //world space center, squared radius
+uniform float cascadeTexels[SHADOW_CASCADES];    //world size of a shadow map texel
+
+//fraction of the directional light reaching fragPos, normal is the geometric normal
+float calcShadow(vec3 fragPos, vec3 normal)
+{
+    for (int i = 0; i < SHADOW_CASCADES; ++i)
+    {
+        vec3 offset = fragPos - cascadeSpheres[i].xyz;
+        if (dot(offset, offset) > cascadeSpheres[i].w)
+            continue;
+
+        //pushed out along the normal by texels of this cascade against acne at grazing angles
+        vec3 position = vec3(shadowMatrices[i] * vec4(fragPos + normal * cascadeTexels[i] * 1.5, 1.0));
+        vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+        //3x3 taps of the hardware filtered comparison
+        float lit = 0.0;
+        for (int y = -1; y <= 1; ++y)
+            for (int x = -1; x <= 1; ++x)
+                lit += texture(shadowMap, vec4(position.xy + vec2(x, y) * texel, float(i), position.z));
+        return lit / 9.0;
+    }
+    //beyond the last cascade
+    return 1.0;
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 330 core
+
+/*
+*lighting passes of the deferred path
+*default         full screen triangle, no vertex buffer
+*LIGHT_VOLUME    instanced unit sphere scaled to the range of light gl_InstanceID
+*/
+
+#ifdef LIGHT_VOLUME
+layout(location = 0) in vec3 aPos;
+
+uniform samplerBuffer clusterLights;
+uniform mat4 viewProjection;
+
+flat out int Light;
+#endif
+
+void main()
+{
+#ifdef LIGHT_VOLUME
+    vec4 positionRange = texelFetch(clusterLights, gl_InstanceID * 3);
+    gl_Position = viewProjection * vec4(positionRange.xyz + aPos * positionRange.w, 1.0);
+    Light = gl_InstanceID;
+#else
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+#endif
+}
\ No newline at end of file
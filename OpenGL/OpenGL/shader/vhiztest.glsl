@@ -0,0 +1,58 @@
+#version 330 core
+
+/*
+*hi-z occlusion test, one bounding sphere per point, rasterization is discarded
+*Visible is captured with transform feedback and read back by HiZCulling a few frames later
+*the box around the sphere is projected with the matrices the pyramid was rendered with
+*/
+
+layout(location = 0) in vec4 aSphere;   //world space center, radius
+
+uniform mat4 viewProjection;
+uniform sampler2D pyramid;
+uniform int pyramidLevels;
+
+flat out uint Visible;
+
+uint occlusionTest()
+{
+    vec3 lo = aSphere.xyz - aSphere.w;
+    vec3 hi = aSphere.xyz + aSphere.w;
+    vec3 ndcMin = vec3(1.0);
+    vec3 ndcMax = vec3(-1.0);
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = vec3((i & 1) != 0 ? hi.x : lo.x, (i & 2) != 0 ? hi.y : lo.y, (i & 4) != 0 ? hi.z : lo.z);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        //crosses the near plane, the projection is not bounded
+        if (clip.w <= 0.0)
+            return 1u;
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+
+    //outside the frustum
+    if (any(greaterThan(ndcMin, vec3(1.0))) || any(lessThan(ndcMax.xy, vec2(-1.0))))
+        return 0u;
+
+    vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+    //the level where the rectangle is at most one texel wide, so it touches at most 2x2 texels
+    vec2 extent = (uvMax - uvMin) * vec2(textureSize(pyramid, 0));
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, pyramidLevels - 1);
+    ivec2 size = textureSize(pyramid, level);
+    ivec2 p0 = min(ivec2(uvMin * vec2(size)), size - 1);
+    ivec2 p1 = min(ivec2(uvMax * vec2(size)), size - 1);
+    float farthest = max(max(texelFetch(pyramid, p0, level).r, texelFetch(pyramid, ivec2(p1.x, p0.y), level).r),
+        max(texelFetch(pyramid, ivec2(p0.x, p1.y), level).r, texelFetch(pyramid, p1, level).r));
+
+    //nearest point of the box behind everything drawn there
+    return ndcMin.z * 0.5 + 0.5 <= farthest ? 1u : 0u;
+}
+
+void main()
+{
+    Visible = occlusionTest();
+    gl_Position = vec4(0.0);
+}
\ No newline at end of file
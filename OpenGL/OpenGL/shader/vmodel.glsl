@@ -1,24 +1,72 @@
 #version 330 core
 
+//permutations: SKINNING, NORMAL_MAP, DEPTH_ONLY (position only, for the depth pre-pass), see ShaderVariants
+
 layout(location = 0) in vec3 aPos;
+#ifndef DEPTH_ONLY
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
+#ifdef NORMAL_MAP
+layout(location = 3) in vec3 aTangent;
+layout(location = 4) in vec3 aBitangent;
+#endif
 layout(location = 5) in vec3 aColor;
+#endif
+#ifdef SKINNING
+layout(location = 6) in ivec4 aBoneIds;
+layout(location = 7) in vec4 aBoneWeights;
+#endif
+
+//the colour pass after a depth pre-pass tests with GL_EQUAL, both passes must produce the same depth
+invariant gl_Position;
 
+#ifndef DEPTH_ONLY
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
 out vec3 Color;
+#ifdef NORMAL_MAP
+out mat3 TBN;
+#endif
+#endif
+
+#ifdef SKINNING
+const int MAX_BONES = 100;
 
+layout(std140) uniform Bones{
+    mat4 bones[MAX_BONES];
+};
+#endif
+
+//per object, computed on the cpu (ObjectTransform)
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 modelViewProjection;
+uniform mat3 normalMatrix;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+#ifdef SKINNING
+    mat4 skin = bones[aBoneIds.x] * aBoneWeights.x
+        + bones[aBoneIds.y] * aBoneWeights.y
+        + bones[aBoneIds.z] * aBoneWeights.z
+        + bones[aBoneIds.w] * aBoneWeights.w;
+    //vertices without bones follow the model transform only
+    if (aBoneWeights.x + aBoneWeights.y + aBoneWeights.z + aBoneWeights.w == 0.0)
+        skin = mat4(1.0);
+#else
+    mat4 skin = mat4(1.0);
+#endif
+
+    vec4 position = skin * vec4(aPos, 1.0);
+    gl_Position = modelViewProjection * position;
+#ifndef DEPTH_ONLY
+    mat3 normalSkin = normalMatrix * mat3(skin);
+    FragPos = vec3(model * position);
+    Normal = normalSkin * aNormal;
     TexCoord = aTexCoord;
     Color = aColor;
+#ifdef NORMAL_MAP
+    TBN = mat3(normalize(normalSkin * aTangent), normalize(normalSkin * aBitangent), normalize(Normal));
+#endif
+#endif
 }
\ No newline at end of file
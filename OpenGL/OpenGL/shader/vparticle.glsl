@@ -0,0 +1,35 @@
+#version 330 core
+
+/*
+*instanced camera facing quad per particle, 4 vertices as a triangle strip and no vertex buffer
+*SORTED    instance i draws the particle at texel i of the order texture instead of particle i
+*/
+
+uniform samplerBuffer particles;    //2 texels per particle: position life, velocity seed
+#ifdef SORTED
+uniform sampler2D order;
+uniform int orderWidth;
+#endif
+uniform mat4 viewProjection;
+uniform vec3 cameraRight;
+uniform vec3 cameraUp;
+uniform float size;
+uniform float lifetime;
+
+out vec2 Corner;
+out float Age;
+
+void main()
+{
+    int index = gl_InstanceID;
+#ifdef SORTED
+    index = int(texelFetch(order, ivec2(gl_InstanceID % orderWidth, gl_InstanceID / orderWidth), 0).y);
+#endif
+    vec4 positionLife = texelFetch(particles, index * 2);
+    Corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    Age = 1.0 - clamp(positionLife.w / lifetime, 0.0, 1.0);
+    //expired particles collapse to a point and produce no fragments
+    float scale = positionLife.w > 0.0 ? size : 0.0;
+    vec3 world = positionLife.xyz + (cameraRight * Corner.x + cameraUp * Corner.y) * scale;
+    gl_Position = viewProjection * vec4(world, 1.0);
+}
\ No newline at end of file
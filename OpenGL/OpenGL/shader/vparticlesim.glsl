@@ -0,0 +1,64 @@
+#version 330 core
+
+/*
+*one simulation step of a particle, rasterization is discarded
+*PositionLife and VelocitySeed are captured with transform feedback into the other state buffer
+*expired particles respawn at the emitter with a direction hashed from their seed and the time
+*/
+
+layout(location = 0) in vec4 aPositionLife;    //xyz position, w remaining life in seconds
+layout(location = 1) in vec4 aVelocitySeed;    //xyz velocity, w particle index
+
+uniform float deltaTime;
+uniform float time;
+uniform vec3 emitter;
+uniform float lifetime;
+uniform float speed;
+
+out vec4 PositionLife;
+out vec4 VelocitySeed;
+
+const vec3 GRAVITY = vec3(0.0, -2.0, 0.0);
+const float DRAG = 0.3;
+
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float random(inout uint seed)
+{
+    seed = hash(seed);
+    return float(seed >> 8) / 16777216.0;
+}
+
+void main()
+{
+    vec3 position = aPositionLife.xyz;
+    vec3 velocity = aVelocitySeed.xyz;
+    float life = aPositionLife.w - deltaTime;
+
+    if (life <= 0.0)
+    {
+        //an upwards cone, the same one ParticleSystem::create starts with
+        uint seed = hash(uint(aVelocitySeed.w)) ^ floatBitsToUint(time);
+        float angle = 6.2831853 * random(seed);
+        float spread = 0.35 * sqrt(random(seed));
+        position = emitter;
+        velocity = normalize(vec3(cos(angle) * spread, 1.0, sin(angle) * spread)) * speed * (0.75 + 0.5 * random(seed));
+        life += lifetime;
+    }
+    else
+    {
+        velocity += (GRAVITY - velocity * DRAG) * deltaTime;
+        position += velocity * deltaTime;
+    }
+
+    PositionLife = vec4(position, life);
+    VelocitySeed = vec4(velocity, aVelocitySeed.w);
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "shader.h"
+#include "shaderreload.h"
+#include "glext.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+
+using std::string;
+using std::vector;
+
+/*
+*named programs compiled together
+*add submits every compile up front, the app keeps loading assets while the driver works,
+*poll finishes what is done in between and finish collects the rest before the first frame
+*/
+class ShaderLibrary
+{
+public:
+	//the returned reference stays valid for the lifetime of the library
+	//feedbackVaryings are captured with transform feedback, in buffer order
+	Shader& add(const string &name, const char* vertexFilePath, const char* fragmentFilePath,
+		const vector<string> &defines = vector<string>(), const vector<string> &feedbackVaryings = vector<string>())
+	{
+		Shader &shader = shaders[name];
+		shader.feedbackVaryings = feedbackVaryings;
+		shader.begin(vertexFilePath, fragmentFilePath, defines);
+		return shader;
+	}
+
+	//nullptr for a name that was never added
+	Shader* get(const string &name)
+	{
+		auto it = shaders.find(name);
+		if (it == shaders.end())
+		{
+			std::cout << "no shader named " << name << std::endl;
+			return nullptr;
+		}
+		return &it->second;
+	}
+
+	//hot reload every program
+	void watch(ShaderReloader &reloader)
+	{
+		for (auto &entry : shaders)
+			reloader.watch(entry.second);
+	}
+
+	//finish the programs the driver is done with, never blocks with KHR_parallel_shader_compile
+	unsigned int poll()
+	{
+		unsigned int pending = 0;
+		for (auto &entry : shaders)
+		{
+			if (entry.second.isReady())
+				entry.second.finish();
+			else
+				++pending;
+		}
+		return pending;
+	}
+
+	//wait for every remaining program
+	void finish()
+	{
+		poll();
+		double total = 0.0;
+		for (auto &entry : shaders)
+		{
+			entry.second.finish();
+			total += entry.second.loadMs;
+		}
+		loadMs = total;
+		std::cout << "shaders: " << shaders.size() << " programs, " << loadMs << " ms on the loading thread"
+			<< (glExtensions().parallelShaderCompile ? ", parallel compile" : "") << std::endl;
+	}
+
+	double loadMs = 0.0;	//summed blocking time of all programs, set by finish
+
+private:
+	std::map<string, Shader> shaders;
+};
\ No newline at end of file
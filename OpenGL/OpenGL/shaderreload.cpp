@@ -0,0 +1,194 @@
+#include "shaderreload.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+//events arriving this soon after the first one are handled together, editors often write several times
+const int RELOAD_SETTLE_MS = 50;
+const int RELOAD_POLL_MS = 250;
+
+bool ShaderReloader::start(GLFWwindow *window, const std::string &_directory)
+{
+	directory = _directory;
+
+	//hidden window whose context shares objects with the one of window
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	context = glfwCreateWindow(1, 1, "shader reload", NULL, window);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if (!context)
+	{
+		std::cout << "shader reload: failed to create a shared context" << std::endl;
+		return false;
+	}
+
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	//editors either rewrite the file or move a new one over it
+	if (inotifyFd < 0 || inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		std::cout << "shader reload: cannot watch " << directory << std::endl;
+		if (inotifyFd >= 0)
+			close(inotifyFd);
+		inotifyFd = -1;
+		glfwDestroyWindow(context);
+		context = nullptr;
+		return false;
+	}
+#endif
+
+	quit = false;
+	thread = std::thread(&ShaderReloader::run, this);
+	std::cout << "shader reload: watching " << directory << std::endl;
+	return true;
+}
+
+void ShaderReloader::stop()
+{
+	if (!context)
+		return;
+	quit = true;
+	if (thread.joinable())
+		thread.join();
+#ifdef __linux__
+	close(inotifyFd);
+	inotifyFd = -1;
+#endif
+	glfwDestroyWindow(context);
+	context = nullptr;
+}
+
+void ShaderReloader::watch(Shader &shader)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const Watched &entry : watched)
+		if (entry.shader == &shader)
+			return;
+	watched.push_back({ &shader, shader.sourceFiles() });
+}
+
+void ShaderReloader::swapReloaded()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const Watched &entry : watched)
+		entry.shader->swapReloaded();
+}
+
+void ShaderReloader::run()
+{
+	glfwMakeContextCurrent(context);
+	std::vector<std::string> changed;
+	while (!quit)
+	{
+		changed.clear();
+		waitForChanges(changed);
+		if (!changed.empty())
+			rebuild(changed);
+	}
+	glfwMakeContextCurrent(NULL);
+}
+
+#ifdef __linux__
+void ShaderReloader::waitForChanges(std::vector<std::string> &changed)
+{
+	pollfd fd = { inotifyFd, POLLIN, 0 };
+	int timeout = RELOAD_POLL_MS;
+	while (poll(&fd, 1, timeout) > 0)
+	{
+		alignas(inotify_event) char buffer[4096];
+		ssize_t size;
+		while ((size = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char *p = buffer; p < buffer + size; )
+			{
+				const inotify_event *event = (const inotify_event*)p;
+				if (event->len > 0)
+				{
+					std::string path = directory + "/" + event->name;
+					if (std::find(changed.begin(), changed.end(), path) == changed.end())
+						changed.push_back(path);
+				}
+				p += sizeof(inotify_event) + event->len;
+			}
+		}
+		timeout = RELOAD_SETTLE_MS;
+	}
+}
+#else
+void ShaderReloader::waitForChanges(std::vector<std::string> &changed)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(RELOAD_POLL_MS));
+
+	std::vector<std::string> files;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const Watched &entry : watched)
+			files.insert(files.end(), entry.files.begin(), entry.files.end());
+	}
+	for (const std::string &file : files)
+	{
+		struct stat info;
+		if (stat(file.c_str(), &info) != 0)
+			continue;
+		auto it = modified.find(file);
+		if (it != modified.end() && it->second != (long long)info.st_mtime
+			&& std::find(changed.begin(), changed.end(), file) == changed.end())
+			changed.push_back(file);
+		modified[file] = (long long)info.st_mtime;
+	}
+}
+#endif
+
+void ShaderReloader::rebuild(const std::vector<std::string> &changed)
+{
+	std::vector<Watched> affected;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const Watched &entry : watched)
+		{
+			for (const std::string &file : entry.files)
+			{
+				if (std::find(changed.begin(), changed.end(), file) != changed.end())
+				{
+					affected.push_back(entry);
+					break;
+				}
+			}
+		}
+	}
+
+	for (Watched &entry : affected)
+	{
+		auto start = std::chrono::steady_clock::now();
+		unsigned int program = entry.shader->rebuild(entry.files);
+		//the window's context only sees a finished link
+		glFinish();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (program)
+		{
+			entry.shader->publishReloaded(program);
+			std::cout << "reloaded " << entry.shader->displayName() << " in " << ms << " ms" << std::endl;
+			reloaded = true;
+			glfwPostEmptyEvent();
+		}
+		else
+			std::cout << entry.shader->displayName() << " failed to compile, keeping the previous program" << std::endl;
+
+		//includes may have been added or removed, an unreadable file keeps the old list
+		if (entry.files.empty())
+			continue;
+		std::lock_guard<std::mutex> lock(mutex);
+		for (Watched &current : watched)
+			if (current.shader == entry.shader)
+				current.files = entry.files;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "shader.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+/*
+*hot reload of glsl files
+*a background thread watches the shader directory (inotify on linux, modification times elsewhere)
+*and rebuilds every watched program using a changed file on a context shared with the window
+*a program that fails to compile is reported and the previous one stays in use
+*/
+class ShaderReloader
+{
+public:
+	~ShaderReloader() { stop(); }
+
+	//creates the shared context, call on the thread owning window
+	bool start(GLFWwindow *window, const std::string &directory);
+	//call before the window is destroyed
+	void stop();
+
+	//the shader must outlive the reloader
+	void watch(Shader &shader);
+	//swap in the programs rebuilt since the last call, once per frame before any uniform is set
+	void swapReloaded();
+
+	//whether a program was reloaded since the last call, a reload also wakes glfwWaitEvents
+	bool takeReloaded()
+	{
+		return reloaded.exchange(false);
+	}
+
+private:
+	struct Watched {
+		Shader *shader;
+		std::vector<std::string> files;
+	};
+
+	GLFWwindow *context = nullptr;
+	std::string directory;
+	std::thread thread;
+	std::atomic<bool> quit{ false };
+	std::atomic<bool> reloaded{ false };
+	std::mutex mutex;
+	std::vector<Watched> watched;
+#ifdef __linux__
+	int inotifyFd = -1;
+#else
+	std::map<std::string, long long> modified;
+#endif
+
+	void run();
+	//blocks for a short while, returns the changed files
+	void waitForChanges(std::vector<std::string> &changed);
+	void rebuild(const std::vector<std::string> &changed);
+};
\ No newline at end of file
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "shader.h"
+#include "shaderreload.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+
+using std::string;
+using std::vector;
+
+//feature keywords of the lit model shaders, each one is a #define in vmodel.glsl/fmodel.glsl
+enum ShaderFeature : unsigned int {
+	FEATURE_TEXTURED = 1 << 0,
+	FEATURE_SPECULAR_MAP = 1 << 1,
+	FEATURE_NORMAL_MAP = 1 << 2,
+	FEATURE_SKINNING = 1 << 3,
+	FEATURE_CLUSTERED = 1 << 4,
+	FEATURE_DEPTH_ONLY = 1 << 5,
+	FEATURE_SHADOWS = 1 << 6,
+	FEATURE_TRANSPARENT = 1 << 7,
+};
+
+struct ShaderPermutation {
+	unsigned int features = 0;
+	unsigned int pointLights = 1;
+
+	ShaderPermutation(unsigned int _features = 0, unsigned int _pointLights = 1) :features(_features), pointLights(_pointLights) {}
+
+	bool operator<(const ShaderPermutation &other) const
+	{
+		return features != other.features ? features < other.features : pointLights < other.pointLights;
+	}
+
+	vector<string> defines() const
+	{
+		vector<string> result;
+		if (features & FEATURE_TEXTURED)
+			result.push_back("TEXTURED");
+		if (features & FEATURE_SPECULAR_MAP)
+			result.push_back("SPECULAR_MAP");
+		if (features & FEATURE_NORMAL_MAP)
+			result.push_back("NORMAL_MAP");
+		if (features & FEATURE_SKINNING)
+			result.push_back("SKINNING");
+		if (features & FEATURE_CLUSTERED)
+			result.push_back("CLUSTERED");
+		if (features & FEATURE_DEPTH_ONLY)
+			result.push_back("DEPTH_ONLY");
+		if (features & FEATURE_SHADOWS)
+			result.push_back("SHADOWS");
+		if (features & FEATURE_TRANSPARENT)
+			result.push_back("TRANSPARENT");
+		result.push_back("POINT_LIGHTS " + std::to_string(pointLights));
+		return result;
+	}
+};
+
+/*
+*specialized programs of one vertex/fragment pair, compiled on first use and kept
+*frame uniforms set with setFrameUniforms are also applied to variants created later in the frame
+*/
+class ShaderVariants
+{
+public:
+	ShaderVariants(const string &_vertexPath, const string &_fragmentPath) :vertexPath(_vertexPath), fragmentPath(_fragmentPath) {}
+
+	//submit the compile without waiting, so variants known at load time overlap with loading
+	void prepare(const ShaderPermutation &permutation)
+	{
+		variant(permutation);
+	}
+
+	Shader& get(const ShaderPermutation &permutation)
+	{
+		Variant &v = variant(permutation);
+		if (!v.ready)
+		{
+			v.shader.finish();
+			if (setup)
+				setup(v.shader);
+			if (frameUniforms)
+				applyFrameUniforms(v.shader);
+			if (reloader)
+				reloader->watch(v.shader);
+			v.ready = true;
+		}
+		return v.shader;
+	}
+
+	//bind the variant unless it is already current, meshes of a model mostly share one
+	//assumes no other program was bound since the last use or invalidate
+	Shader& use(const ShaderPermutation &permutation)
+	{
+		Shader &shader = get(permutation);
+		if (&shader != current)
+		{
+			shader.use();
+			current = &shader;
+		}
+		return shader;
+	}
+
+	//forget the current variant, the next use binds again
+	//every pass starts with it, other programs (lights, post passes, other variants) may be bound in between
+	void invalidate()
+	{
+		current = nullptr;
+	}
+
+	//waits for every prepared variant
+	void finish()
+	{
+		for (auto &entry : programs)
+			get(entry.first);
+	}
+
+	//called once per program, e.g. for uniform block bindings
+	void setSetup(const std::function<void(Shader&)> &func)
+	{
+		setup = func;
+		for (auto &entry : programs)
+			if (entry.second.ready)
+				setup(entry.second.shader);
+	}
+
+	//per-frame uniforms (camera, lights) applied to every finished variant and to variants finished later
+	void setFrameUniforms(const std::function<void(Shader&)> &func)
+	{
+		frameUniforms = func;
+		for (auto &entry : programs)
+			if (entry.second.ready)
+				applyFrameUniforms(entry.second.shader);
+		//the last variant set up is bound now, but not necessarily when the pass using it starts
+		invalidate();
+	}
+
+	//hot reload every finished variant and the ones finished later
+	void watch(ShaderReloader &_reloader)
+	{
+		reloader = &_reloader;
+		for (auto &entry : programs)
+			if (entry.second.ready)
+				reloader->watch(entry.second.shader);
+	}
+
+	size_t size() const { return programs.size(); }
+
+	double loadMs() const
+	{
+		double total = 0.0;
+		for (const auto &entry : programs)
+			total += entry.second.shader.loadMs;
+		return total;
+	}
+
+private:
+	struct Variant {
+		Shader shader;
+		bool ready = false;	//finished and set up
+	};
+
+	string vertexPath, fragmentPath;
+	std::map<ShaderPermutation, Variant> programs;
+	std::function<void(Shader&)> setup;
+	std::function<void(Shader&)> frameUniforms;
+	Shader *current = nullptr;
+	ShaderReloader *reloader = nullptr;
+
+	Variant& variant(const ShaderPermutation &permutation)
+	{
+		auto it = programs.find(permutation);
+		if (it != programs.end())
+			return it->second;
+		Variant &v = programs[permutation];
+		v.shader.begin(vertexPath.c_str(), fragmentPath.c_str(), permutation.defines());
+		return v;
+	}
+
+	void applyFrameUniforms(Shader &shader)
+	{
+		shader.use();
+		frameUniforms(shader);
+		current = &shader;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,351 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "shadervariants.h"
+#include "profiler.h"
+
+#include <vector>
+#include <cmath>
+#include <iostream>
+#include <functional>
+
+using std::vector;
+
+const unsigned int SHADOW_CASCADES = 4;	//also in shadows.glsl
+const unsigned int SHADOW_MAP_SIZE = 1024;
+const unsigned int SHADOW_TEXTURE_UNIT = 11;
+//cascades cover the view up to this distance, farther surfaces are lit
+const float SHADOW_DISTANCE = 30.0f;
+//blend of logarithmic and uniform split distances
+const float SHADOW_SPLIT_LAMBDA = 0.75f;
+//casters this far outside a cascade towards the light still shadow it
+const float SHADOW_CASTER_MARGIN = 20.0f;
+//gpu scope names, they must outlive the profiler
+const char *const SHADOW_CASCADE_SCOPES[SHADOW_CASCADES] = { "shadow cascade 0", "shadow cascade 1", "shadow cascade 2", "shadow cascade 3" };
+
+//a camera the cascades cover, tanX and tanY are the tangents of its half field of view
+struct ShadowView {
+	glm::mat4 view;
+	float tanX, tanY;
+	unsigned int version;	//changes with view or projection, see Camera::version
+};
+
+//cascades per frame since the last report
+struct ShadowStats {
+	unsigned int staticRenders = 0;	//static casters drawn again
+	unsigned int dynamicRenders = 0;	//cached static depth copied and the moving casters drawn over it
+	unsigned int cached = 0;		//nothing drawn
+	unsigned int frames = 0;
+};
+
+/*
+*cascaded shadow maps of the directional light
+*every cascade is a sphere around a slice of the view frustum, so its size does not change when the camera turns,
+*and its light space position is snapped to whole texels (and coarse depth steps), so the matrix only changes
+*after the camera moved by more than a texel
+*
+*with several views (split screen) every cascade is the smallest sphere around the slices of all of them,
+*its size then also changes when the views move apart, a single view keeps the stable radius
+*
+*static casters are rendered into a cache array that is only redrawn when the matrix, the light or the scene changed,
+*the sampled array is a copy of it with the moving casters drawn over, skipped while no moving caster overlaps
+*/
+class CascadedShadows
+{
+public:
+	//depth-only variants of vmodel.glsl, drawn with the position-only vertex stream
+	ShaderVariants shaders{ "shader/vmodel.glsl", "shader/fdepth.glsl" };
+	ShadowStats stats;
+
+	void create()
+	{
+		staticMaps = createArray(false);
+		shadowMaps = createArray(true);
+		glGenFramebuffers(1, &readFBO);
+		glGenFramebuffers(1, &drawFBO);
+		//depth-only framebuffers, the buffer state belongs to the bound framebuffer
+		for (unsigned int FBO : { readFBO, drawFBO })
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMaps, 0, 0);
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	/*
+	*fit the cascades to the camera, nearDistance and fovy (radians) as in its projection
+	*sceneVersion changes whenever a static caster moved, see SceneGraph::version
+	*viewVersion changes with view, fovy or aspect, see Camera::version, the fit is skipped while neither changes
+	*/
+	void update(const glm::mat4 &view, float fovy, float aspect, float nearDistance, const glm::vec3 &lightDirection, unsigned int sceneVersion, unsigned int viewVersion)
+	{
+		float tanY = std::tan(fovy * 0.5f);
+		ShadowView single = { view, tanY * aspect, tanY, viewVersion };
+		update(&single, 1, nearDistance, lightDirection, sceneVersion);
+	}
+
+	//fit the cascades to count views, all with the same nearDistance
+	void update(const ShadowView *views, unsigned int count, float nearDistance, const glm::vec3 &lightDirection, unsigned int sceneVersion)
+	{
+		glm::vec3 direction = glm::normalize(lightDirection);
+		bool lightChanged = direction != lastDirection || sceneVersion != lastSceneVersion;
+		bool viewsChanged = count != lastViewVersions.size();
+		for (unsigned int v = 0; v < count && !viewsChanged; ++v)
+			viewsChanged = views[v].version != lastViewVersions[v];
+		if (!lightChanged && fitted && !viewsChanged)
+			return;
+		lastDirection = direction;
+		lastSceneVersion = sceneVersion;
+		lastViewVersions.resize(count);
+		for (unsigned int v = 0; v < count; ++v)
+			lastViewVersions[v] = views[v].version;
+		fitted = true;
+
+		glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+		vector<glm::mat4> inverseViews(count);
+		for (unsigned int v = 0; v < count; ++v)
+			inverseViews[v] = glm::inverse(views[v].view);
+
+		float sliceNear = nearDistance;
+		for (unsigned int i = 0; i < SHADOW_CASCADES; ++i)
+		{
+			Cascade &cascade = cascades[i];
+			float t = (float)(i + 1) / SHADOW_CASCADES;
+			float sliceFar = SHADOW_SPLIT_LAMBDA * nearDistance * std::pow(SHADOW_DISTANCE / nearDistance, t)
+				+ (1.0f - SHADOW_SPLIT_LAMBDA) * (nearDistance + (SHADOW_DISTANCE - nearDistance) * t);
+
+			glm::vec3 center;
+			float radius = 0.0f;
+			for (unsigned int v = 0; v < count; ++v)
+			{
+				//smallest sphere around the slice, its center lies on the view axis
+				float k2 = views[v].tanX * views[v].tanX + views[v].tanY * views[v].tanY;
+				float centerDepth = std::min(0.5f * (sliceNear + sliceFar) * (1.0f + k2), sliceFar);
+				float sliceRadius = std::sqrt((sliceFar - centerDepth) * (sliceFar - centerDepth) + sliceFar * sliceFar * k2);
+				glm::vec3 sliceCenter = glm::vec3(inverseViews[v] * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+				if (v == 0)
+				{
+					center = sliceCenter;
+					radius = sliceRadius;
+					continue;
+				}
+				//grow the sphere so it holds this slice too
+				glm::vec3 offset = sliceCenter - center;
+				float distance = glm::length(offset);
+				if (distance + sliceRadius <= radius)
+					continue;
+				if (distance + radius <= sliceRadius)
+				{
+					center = sliceCenter;
+					radius = sliceRadius;
+					continue;
+				}
+				float grown = 0.5f * (distance + radius + sliceRadius);
+				center += offset * ((grown - radius) / distance);
+				radius = grown;
+			}
+			//for one view the radius only depends on the projection, round it so it is exactly the same every frame
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+			sliceNear = sliceFar;
+
+			float texel = 2.0f * radius / SHADOW_MAP_SIZE;
+			float depthStep = radius * 0.5f;
+			glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+			lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+			lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+			lightCenter.z = std::floor(lightCenter.z / depthStep) * depthStep;
+			//the snapped box still holds the sphere, it may lie up to a texel and a depth step off
+			glm::mat4 projection = glm::ortho(lightCenter.x - radius - texel, lightCenter.x + radius + texel,
+				lightCenter.y - radius - texel, lightCenter.y + radius + texel,
+				-lightCenter.z - radius - depthStep - SHADOW_CASTER_MARGIN, -lightCenter.z + radius + texel);
+			glm::mat4 viewProjection = projection * lightRotation;
+
+			if (lightChanged || viewProjection != cascade.viewProjection)
+				cascade.staticValid = false;
+			cascade.viewProjection = viewProjection;
+			cascade.sphere = glm::vec4(center, radius);
+			cascade.texel = texel;
+		}
+	}
+
+	/*
+	*render the cascades that changed, both callbacks draw depth with the given view projection
+	*dynamicBounds are world space spheres of the moving casters drawDynamic draws
+	*/
+	void render(Profiler &profiler, const std::function<void(const glm::mat4&)> &drawStatic,
+		const std::function<void(const glm::mat4&)> &drawDynamic, const vector<glm::vec4> &dynamicBounds)
+	{
+		shaders.finish();
+		//every matrix is per object, there are no frame uniforms, only the bound variant is forgotten
+		shaders.invalidate();
+
+		GLint bound = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.0f, 4.0f);
+
+		++stats.frames;
+		for (unsigned int i = 0; i < SHADOW_CASCADES; ++i)
+		{
+			Cascade &cascade = cascades[i];
+			bool dynamic = overlapsDynamic(cascade, dynamicBounds);
+			if (cascade.staticValid && !dynamic && cascade.copyValid)
+			{
+				++stats.cached;
+				continue;
+			}
+
+			PROFILE_GPU_SCOPE(profiler, SHADOW_CASCADE_SCOPES[i]);
+			if (!cascade.staticValid)
+			{
+				bindLayer(GL_FRAMEBUFFER, drawFBO, staticMaps, i);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				drawStatic(cascade.viewProjection);
+				cascade.staticValid = true;
+				cascade.copyValid = false;
+				++stats.staticRenders;
+			}
+
+			bindLayer(GL_READ_FRAMEBUFFER, readFBO, staticMaps, i);
+			bindLayer(GL_DRAW_FRAMEBUFFER, drawFBO, shadowMaps, i);
+			glBlitFramebuffer(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			cascade.copyValid = !dynamic;
+			if (dynamic)
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER, drawFBO);
+				drawDynamic(cascade.viewProjection);
+				++stats.dynamicRenders;
+			}
+		}
+
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glBindFramebuffer(GL_FRAMEBUFFER, bound);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	//bind the shadow maps to their texture unit, once per frame before drawing
+	void bind() const
+	{
+		glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMaps);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	//uniforms of shader/shadows.glsl, the shader must be in use
+	void setUniforms(Shader &shader) const
+	{
+		//depth range and xy from [-1, 1] to texture coordinates
+		const glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+		glm::mat4 matrices[SHADOW_CASCADES];
+		glm::vec4 spheres[SHADOW_CASCADES];
+		float texels[SHADOW_CASCADES];
+		for (unsigned int i = 0; i < SHADOW_CASCADES; ++i)
+		{
+			const Cascade &cascade = cascades[i];
+			matrices[i] = bias * cascade.viewProjection;
+			//a little inside the sphere, so the filter and the normal offset stay within the map
+			float radius = cascade.sphere.w - 4.0f * cascade.texel;
+			spheres[i] = glm::vec4(glm::vec3(cascade.sphere), radius * radius);
+			texels[i] = cascade.texel;
+		}
+		shader.setInt("shadowMap", SHADOW_TEXTURE_UNIT);
+		glUniformMatrix4fv(glGetUniformLocation(shader.ID, "shadowMatrices"), SHADOW_CASCADES, GL_FALSE, &matrices[0][0][0]);
+		glUniform4fv(glGetUniformLocation(shader.ID, "cascadeSpheres"), SHADOW_CASCADES, &spheres[0][0]);
+		glUniform1fv(glGetUniformLocation(shader.ID, "cascadeTexels"), SHADOW_CASCADES, texels);
+	}
+
+	//cascade work per frame and the gpu time of every cascade since the last report
+	void report(std::ostream &out, const Profiler &profiler)
+	{
+		if (stats.frames == 0)
+			return;
+		double frames = stats.frames;
+		out << "shadows: per frame " << stats.staticRenders / frames << " static renders, " << stats.dynamicRenders / frames
+			<< " dynamic, " << stats.cached / frames << " cached of " << SHADOW_CASCADES << " cascades, gpu ms";
+		for (unsigned int i = 0; i < SHADOW_CASCADES; ++i)
+			out << " " << profiler.gpuAverage(SHADOW_CASCADE_SCOPES[i]);
+		out << std::endl;
+		stats = ShadowStats();
+	}
+
+private:
+	struct Cascade {
+		glm::mat4 viewProjection = glm::mat4(1.0f);
+		glm::vec4 sphere = glm::vec4(0.0f);	//world space center, radius
+		float texel = 0.0f;		//world size of a shadow map texel
+		bool staticValid = false;	//cached static depth matches viewProjection
+		bool copyValid = false;	//sampled layer equals the cached static depth
+	};
+
+	Cascade cascades[SHADOW_CASCADES];
+	unsigned int staticMaps = 0, shadowMaps = 0;
+	unsigned int readFBO = 0, drawFBO = 0;
+	glm::vec3 lastDirection = glm::vec3(0.0f);
+	unsigned int lastSceneVersion = 0;
+	vector<unsigned int> lastViewVersions;	//per view of the last fit
+	bool fitted = false;
+
+	//compare enables hardware filtered depth comparison with sampler2DArrayShadow
+	unsigned int createArray(bool compare)
+	{
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_CASCADES, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		if (compare)
+		{
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		return texture;
+	}
+
+	static void bindLayer(GLenum target, unsigned int FBO, unsigned int texture, unsigned int layer)
+	{
+		glBindFramebuffer(target, FBO);
+		glFramebufferTextureLayer(target, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+	}
+
+	//sphere against the light space box of the cascade, extended towards the light by the caster margin
+	static bool overlapsDynamic(const Cascade &cascade, const vector<glm::vec4> &bounds)
+	{
+		glm::mat4 inverse = glm::inverse(cascade.viewProjection);
+		glm::vec3 axisX = glm::vec3(inverse[0]), axisY = glm::vec3(inverse[1]), axisZ = glm::vec3(inverse[2]);
+		glm::vec3 origin = glm::vec3(inverse[3]);
+		for (const glm::vec4 &sphere : bounds)
+		{
+			//clip space of an orthographic projection is linear, compare along each box axis
+			glm::vec3 offset = glm::vec3(sphere) - origin;
+			bool inside = true;
+			for (const glm::vec3 &axis : { axisX, axisY, axisZ })
+			{
+				float length2 = glm::dot(axis, axis);
+				float distance = glm::dot(offset, axis) / length2;
+				float extent = sphere.w / std::sqrt(length2);
+				if (distance - extent > 1.0f || distance + extent < -1.0f)
+				{
+					inside = false;
+					break;
+				}
+			}
+			if (inside)
+				return true;
+		}
+		return false;
+	}
+};
\ No newline at end of file
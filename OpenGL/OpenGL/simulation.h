@@ -0,0 +1,296 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+//simulation ticks per second, independent of the frame rate
+const double SIMULATION_RATE = 120.0;
+//input events the window thread may queue ahead of the simulation
+const unsigned int INPUT_QUEUE_SIZE = 1024;
+
+/*
+*lock-free queue of one producer and one consumer thread
+*push and pop never block, push fails while the queue is full
+*/
+template <typename T, unsigned int N>
+class SpscQueue
+{
+public:
+	bool push(const T &item)
+	{
+		unsigned int tail = this->tail.load(std::memory_order_relaxed);
+		unsigned int next = (tail + 1) % N;
+		if (next == head.load(std::memory_order_acquire))
+			return false;
+		items[tail] = item;
+		this->tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &item)
+	{
+		unsigned int head = this->head.load(std::memory_order_relaxed);
+		if (head == tail.load(std::memory_order_acquire))
+			return false;
+		item = items[head];
+		this->head.store((head + 1) % N, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T items[N];
+	//on separate cache lines, each is written by one thread only
+	alignas(64) std::atomic<unsigned int> head{ 0 };
+	alignas(64) std::atomic<unsigned int> tail{ 0 };
+};
+
+enum InputEventType {
+	INPUT_KEY,			//key, pressed
+	INPUT_MOUSE_MOVE,	//x, y offsets in pixels summed over a frame, y up
+	INPUT_SCROLL,		//y offset summed over a frame
+};
+
+struct InputEvent {
+	InputEventType type;
+	int key;
+	bool pressed;
+	float x, y;
+	std::chrono::steady_clock::time_point time;	//when the window thread received it
+};
+
+//what the render thread needs of the simulation, interpolated between two ticks
+struct CameraState {
+	glm::vec3 position;
+	float yaw, pitch, zoom;
+
+	static CameraState of(const Camera &camera)
+	{
+		return { camera.position, camera.yaw, camera.pitch, camera.zoom };
+	}
+
+	static CameraState mix(const CameraState &a, const CameraState &b, float t)
+	{
+		//yaw is not wrapped, so plain interpolation never takes the long way round
+		return { glm::mix(a.position, b.position, t), glm::mix(a.yaw, b.yaw, t), glm::mix(a.pitch, b.pitch, t), glm::mix(a.zoom, b.zoom, t) };
+	}
+
+	bool operator==(const CameraState &other) const
+	{
+		return position == other.position && yaw == other.yaw && pitch == other.pitch && zoom == other.zoom;
+	}
+
+	void apply(Camera &camera) const
+	{
+		camera.position = position;
+		camera.zoom = zoom;
+		camera.setOrientation(yaw, pitch);
+	}
+};
+
+/*
+*fixed timestep simulation on its own thread
+*the window thread pushes input events from the glfw callbacks, the simulation applies them to its own
+*camera every tick and publishes the last two states, the render thread draws between them
+*so movement does not depend on the frame rate and a slow frame does not delay the input
+*/
+class Simulation
+{
+public:
+	~Simulation()
+	{
+		stop();
+	}
+
+	void start(const Camera &camera)
+	{
+		simulated = camera;
+		previous = current = CameraState::of(camera);
+		currentTime = lastReport = std::chrono::steady_clock::now();
+		quit = false;
+		thread = std::thread(&Simulation::run, this);
+	}
+
+	void stop()
+	{
+		quit = true;
+		if (thread.joinable())
+			thread.join();
+	}
+
+	//window thread only
+	void push(const InputEvent &event)
+	{
+		if (!events.push(event))
+			dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void pushKey(int key, bool pressed)
+	{
+		push({ INPUT_KEY, key, pressed, 0.0f, 0.0f, std::chrono::steady_clock::now() });
+	}
+
+	/*
+	*cursor and scroll callbacks can fire many times per frame with a high rate mouse,
+	*their offsets are summed here and queued as one event each by flushInput after polling
+	*/
+	void addMouseMove(float x, float y)
+	{
+		mouse += glm::vec2(x, y);
+		++cursorEvents;
+	}
+
+	void addScroll(float y)
+	{
+		scroll += y;
+	}
+
+	void flushInput()
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (mouse != glm::vec2(0.0f))
+			push({ INPUT_MOUSE_MOVE, 0, false, mouse.x, mouse.y, now });
+		if (scroll != 0.0f)
+			push({ INPUT_SCROLL, 0, false, 0.0f, scroll, now });
+		mouse = glm::vec2(0.0f);
+		scroll = 0.0f;
+		++flushes;
+	}
+
+	//state one tick behind the simulation, interpolated to now
+	CameraState sample()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		double step = 1.0 / SIMULATION_RATE;
+		double since = std::chrono::duration<double>(std::chrono::steady_clock::now() - currentTime).count();
+		return CameraState::mix(previous, current, (float)std::min(since / step, 1.0));
+	}
+
+	//whether a tick moved the camera since the last call, such a tick also wakes glfwWaitEvents
+	bool takeChanged()
+	{
+		return changed.exchange(false);
+	}
+
+	//ticks, events and the longest an event waited in the queue since the last report
+	void report(std::ostream &out)
+	{
+		auto now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(now - lastReport).count();
+		lastReport = now;
+		unsigned int tickCount = ticks.exchange(0);
+		unsigned int eventCount = handled.exchange(0);
+		double wait = maxWait.exchange(0) / 1000.0;
+		out << "simulation: " << (seconds > 0.0 ? tickCount / seconds : 0.0) << " ticks/s, " << eventCount << " input events, longest queued "
+			<< wait << " ms, " << dropped.exchange(0) << " dropped, " << (flushes ? (double)cursorEvents / flushes : 0.0)
+			<< " cursor events per frame" << std::endl;
+		cursorEvents = flushes = 0;
+	}
+
+private:
+	SpscQueue<InputEvent, INPUT_QUEUE_SIZE> events;
+	std::thread thread;
+	std::atomic<bool> quit{ false };
+
+	//window thread only
+	glm::vec2 mouse = glm::vec2(0.0f);
+	float scroll = 0.0f;
+	unsigned int cursorEvents = 0, flushes = 0;
+
+	//simulation thread only
+	Camera simulated;
+	bool held[4] = {};	//forward, backward, left, right
+
+	//published states, guarded by mutex
+	std::mutex mutex;
+	CameraState previous, current;
+	std::chrono::steady_clock::time_point currentTime;
+
+	std::atomic<bool> changed{ false };
+	std::atomic<unsigned int> ticks{ 0 }, handled{ 0 }, dropped{ 0 };
+	std::atomic<long long> maxWait{ 0 };	//microseconds
+	std::chrono::steady_clock::time_point lastReport;
+
+	void run()
+	{
+		auto step = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / SIMULATION_RATE));
+		auto next = std::chrono::steady_clock::now();
+		while (!quit)
+		{
+			next += step;
+			std::this_thread::sleep_until(next);
+			auto now = std::chrono::steady_clock::now();
+			//far behind, e.g. after a debugger break, skip the missed ticks instead of catching up
+			if (now - next > step * 8)
+				next = now;
+
+			tick((float)(1.0 / SIMULATION_RATE), now);
+
+			CameraState state = CameraState::of(simulated);
+			bool moved;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				//the render thread interpolates until previous catches up, so it keeps drawing one tick longer
+				moved = !(state == current && current == previous);
+				previous = current;
+				current = state;
+				currentTime = now;
+			}
+			if (moved)
+			{
+				changed = true;
+				glfwPostEmptyEvent();
+			}
+		}
+	}
+
+	void tick(float deltaTime, std::chrono::steady_clock::time_point now)
+	{
+		InputEvent event;
+		long long longest = 0;
+		unsigned int count = 0;
+		//every frame queued since the last tick turns the camera once, its basis is rebuilt once
+		glm::vec2 look(0.0f);
+		while (events.pop(event))
+		{
+			longest = std::max(longest, (long long)std::chrono::duration_cast<std::chrono::microseconds>(now - event.time).count());
+			++count;
+			switch (event.type)
+			{
+			case INPUT_KEY:
+				if (event.key >= 0 && event.key < 4)
+					held[event.key] = event.pressed;
+				break;
+			case INPUT_MOUSE_MOVE:
+				look += glm::vec2(event.x, event.y);
+				break;
+			case INPUT_SCROLL:
+				simulated.processMouseScroll(event.y);
+				break;
+			}
+		}
+
+		if (look != glm::vec2(0.0f))
+			simulated.processMouseMovement(look.x, look.y);
+
+		const move_t moves[4] = { FORWARD, BACKWARD, LEFT, RIGHT };
+		for (unsigned int i = 0; i < 4; ++i)
+			if (held[i])
+				simulated.processKeyboard(moves[i], deltaTime);
+
+		ticks.fetch_add(1, std::memory_order_relaxed);
+		handled.fetch_add(count, std::memory_order_relaxed);
+		long long seen = maxWait.load(std::memory_order_relaxed);
+		while (longest > seen && !maxWait.compare_exchange_weak(seen, longest))
+			;
+	}
+};
\ No newline at end of file
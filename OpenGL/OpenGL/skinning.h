@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "model.h"
+
+#include <vector>
+
+using std::vector;
+
+//uniform buffer binding point of the Bones block
+const unsigned int BONE_BINDING = 0;
+
+/*
+*bone matrices of many instances in one uniform buffer
+*every instance owns an aligned MAX_BONES slot that is bound to the Bones block before its draw
+*/
+class BonePalette
+{
+public:
+	unsigned int UBO;
+
+	BonePalette(unsigned int instances) :capacity(instances)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		size_t slotSize = MAX_BONES * sizeof(glm::mat4);
+		stride = (slotSize + alignment - 1) / alignment * alignment;
+
+		staging.resize(stride * capacity);
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, staging.size(), NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	//MAX_BONES matrices of instance, filled in place by the pose evaluator
+	glm::mat4* slot(unsigned int instance)
+	{
+		return (glm::mat4*)&staging[instance * stride];
+	}
+
+	//one upload per frame, the buffer is orphaned so the driver does not wait for last frame's draws
+	void upload()
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, staging.size(), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size(), staging.data());
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void bind(unsigned int instance)
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, BONE_BINDING, UBO, instance * stride, MAX_BONES * sizeof(glm::mat4));
+	}
+
+private:
+	unsigned int capacity;
+	size_t stride;
+	vector<unsigned char> staging;
+};
\ No newline at end of file
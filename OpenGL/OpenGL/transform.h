@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include "shader.h"
+
+/*
+*per-object matrices of vmodel.glsl and vlight.glsl, computed once per object on the cpu
+*instead of a 4x4 inverse and two matrix products for every vertex
+*/
+struct ObjectTransform {
+	glm::mat4 model = glm::mat4(1.0f);
+	glm::mat4 modelViewProjection = glm::mat4(1.0f);
+	glm::mat3 normalMatrix = glm::mat3(1.0f);	//inverse transpose of the upper 3x3 of model
+
+	ObjectTransform() {}
+	ObjectTransform(const glm::mat4 &world, const glm::mat4 &viewProjection)
+	{
+		setModel(world);
+		project(viewProjection);
+	}
+
+	//the normal matrix only changes with the world matrix, a 3x3 inverse is enough
+	void setModel(const glm::mat4 &world)
+	{
+		model = world;
+		normalMatrix = glm::inverseTranspose(glm::mat3(world));
+	}
+
+	//once per frame, after the camera moved
+	void project(const glm::mat4 &viewProjection)
+	{
+		modelViewProjection = viewProjection * model;
+	}
+
+	void apply(Shader &shader) const
+	{
+		shader.setMat4("model", model);
+		shader.setMat4("modelViewProjection", modelViewProjection);
+		shader.setMat3("normalMatrix", normalMatrix);
+	}
+};
\ No newline at end of file
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "scene.h"
+#include "shadervariants.h"
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <iostream>
+
+using std::vector;
+
+//views of a split screen, the visibility of each sphere is one bit per view
+const unsigned int MAX_VIEWS = 4;
+
+struct Viewport {
+	int x, y, width, height;
+};
+
+struct MultiViewStats {
+	unsigned int views = 0;
+	unsigned int spheres = 0;
+	unsigned int tests = 0;		//sphere against frustum tests of the last cull, 0 when every view was reused
+	unsigned int rejected = 0;	//spheres outside the bounds of every changed view, no frustum tested
+	unsigned int reused = 0;	//views whose bits were kept
+	unsigned int shared = 0;	//changed views that took the bits of a view with the same frustum
+	unsigned int items = 0;		//draws in the queue
+};
+
+/*
+*split screen rendering of one scene from several cameras
+*the views share the context and with it every mesh, texture and program, and the scene is updated,
+*sorted and posed once per frame for all of them
+*
+*culling is one pass over the bounding spheres that sets a bit per view, a view whose camera
+*and the scene did not change keeps its bits, e.g. a fixed overview camera costs nothing while the scene is still
+*the views that changed are tested together: a sphere outside the bounding sphere of all their frusta is rejected
+*with one test, views with the same view projection (new views start as copies) share one set of tests,
+*and a sphere missing the bounding sphere of a frustum skips its planes
+*the draws of all views go into one queue sorted by view, shader variant and distance,
+*so every view binds its viewport and frame uniforms once and switches programs as rarely as possible
+*/
+class MultiView
+{
+public:
+	vector<Camera> cameras;
+	vector<Viewport> viewports;
+	MultiViewStats stats;
+
+	unsigned int count() const
+	{
+		return (unsigned int)cameras.size();
+	}
+
+	//new views start as copies of camera
+	void resize(unsigned int views, const Camera &camera)
+	{
+		views = std::min(std::max(views, 1u), MAX_VIEWS);
+		cameras.resize(views, camera);
+		viewports.resize(views);
+		cached.resize(views);
+		for (CachedView &view : cached)
+			view.valid = false;
+	}
+
+	//side by side for two views, a 2x2 grid for more, the last row is left empty with three
+	void layout(int width, int height)
+	{
+		unsigned int columns = count() > 1 ? 2 : 1;
+		unsigned int rows = (count() + columns - 1) / columns;
+		for (unsigned int i = 0; i < count(); ++i)
+		{
+			int column = i % columns, row = i / columns;
+			int x0 = width * column / columns, x1 = width * (column + 1) / columns;
+			//row 0 on top
+			int y0 = height * (rows - row - 1) / rows, y1 = height * (rows - row) / rows;
+			viewports[i] = { x0, y0, std::max(x1 - x0, 1), std::max(y1 - y0, 1) };
+		}
+	}
+
+	//cached matrices of every camera for its own viewport
+	void updateCameras(float nearDistance, float farDistance)
+	{
+		for (unsigned int i = 0; i < count(); ++i)
+			cameras[i].update((float)viewports[i].width / (float)viewports[i].height, nearDistance, farDistance);
+	}
+
+	/*
+	*bit v of visibility()[i] is set when view v sees spheres[i]
+	*sceneVersion changes whenever a sphere may have moved, see SceneGraph::version
+	*/
+	void cull(const vector<glm::vec4> &spheres, unsigned int sceneVersion)
+	{
+		bool sameScene = sceneVersion == cullSceneVersion && spheres.size() == visible.size();
+		unsigned char keep = 0;
+		for (unsigned int i = 0; i < count(); ++i)
+		{
+			if (sameScene && cached[i].valid && cached[i].version == cameras[i].version)
+				keep |= 1 << i;
+			cached[i].valid = true;
+			cached[i].version = cameras[i].version;
+		}
+		cullSceneVersion = sceneVersion;
+		visible.resize(spheres.size(), 0);
+
+		stats.views = count();
+		stats.spheres = (unsigned int)spheres.size();
+		stats.tests = 0;
+		stats.rejected = 0;
+		stats.reused = 0;
+		stats.shared = 0;
+		for (unsigned int i = 0; i < count(); ++i)
+			stats.reused += (keep >> i) & 1;
+		unsigned char all = (unsigned char)((1 << count()) - 1);
+		if (keep == all)
+			return;
+
+		//views tested this cull, each with the bit mask of the views that share its frustum
+		unsigned int tested[MAX_VIEWS];
+		unsigned char masks[MAX_VIEWS];
+		unsigned int testedCount = 0;
+		glm::vec4 bounds = glm::vec4(0.0f);
+		for (unsigned int i = 0; i < count(); ++i)
+		{
+			if (keep & (1 << i))
+				continue;
+			unsigned int t = 0;
+			while (t < testedCount && cameras[tested[t]].viewProjection != cameras[i].viewProjection)
+				++t;
+			if (t < testedCount)
+			{
+				masks[t] |= 1 << i;
+				++stats.shared;
+				continue;
+			}
+			tested[testedCount] = i;
+			masks[testedCount] = (unsigned char)(1 << i);
+			cached[i].bounds = frustumBounds(cameras[i].viewProjection);
+			bounds = testedCount ? enclose(bounds, cached[i].bounds) : cached[i].bounds;
+			++testedCount;
+		}
+
+		//each sphere is loaded once and tested against every view that changed
+		for (size_t s = 0; s < spheres.size(); ++s)
+		{
+			unsigned char bits = visible[s] & keep;
+			const glm::vec4 &sphere = spheres[s];
+			if (!overlaps(bounds, sphere))
+			{
+				++stats.rejected;
+				visible[s] = bits;
+				continue;
+			}
+			for (unsigned int t = 0; t < testedCount; ++t)
+			{
+				const unsigned int i = tested[t];
+				if (testedCount > 1 && !overlaps(cached[i].bounds, sphere))
+					continue;
+				if (cameras[i].frustum.intersects(sphere))
+					bits |= masks[t];
+				++stats.tests;
+			}
+			visible[s] = bits;
+		}
+	}
+
+	const vector<unsigned char>& visibility() const
+	{
+		return visible;
+	}
+
+	/*
+	*queue every visible draw of every view, spheres as given to the last cull:
+	*the meshes of scene in node order (scene.meshBounds) followed by the instances drawn by drawInstance
+	*transparent meshes are left to SceneGraph::drawTransparent as in the single view
+	*/
+	void buildQueue(SceneGraph &scene, const vector<glm::vec4> &spheres, const ShaderPermutation &sceneBase)
+	{
+		unsigned int meshes = (unsigned int)scene.meshBounds.size();
+		queue.clear();
+		for (unsigned int v = 0; v < count(); ++v)
+		{
+			const glm::vec3 &eye = cameras[v].position;
+			unsigned int bounds = 0;
+			for (unsigned int n = 0; n < scene.nodes.size(); ++n)
+			{
+				const SceneNode &node = scene.nodes[n];
+				for (unsigned int m = 0; m < node.meshes.size(); ++m, ++bounds)
+				{
+					if (!(visible[bounds] & (1 << v)))
+						continue;
+					const Mesh &mesh = node.model->meshes[node.meshes[m]];
+					if (scene.transparency && mesh.transparent())
+						continue;
+					queue.push_back({ key(v, 0, sceneBase.features | mesh.features(), spheres[bounds], eye), n, m });
+				}
+			}
+			for (unsigned int i = meshes; i < spheres.size(); ++i)
+				if (visible[i] & (1 << v))
+					queue.push_back({ key(v, 1, 0, spheres[i], eye), i - meshes, 0 });
+		}
+		std::sort(queue.begin(), queue.end(), [](const QueueItem &a, const QueueItem &b) { return a.key < b.key; });
+		stats.items = (unsigned int)queue.size();
+		sceneBasePermutation = sceneBase;
+	}
+
+	/*
+	*draw the queue, beginView binds the frame uniforms of a view before its first draw
+	*drawInstance draws one instance with the view projection of its view
+	*/
+	void submit(SceneGraph &scene, ShaderVariants &variants, const std::function<void(unsigned int)> &beginView,
+		const std::function<void(unsigned int, const glm::mat4&)> &drawInstance)
+	{
+		variants.invalidate();
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		unsigned int current = (unsigned int)-1;
+		for (const QueueItem &item : queue)
+		{
+			unsigned int v = (unsigned int)(item.key >> VIEW_SHIFT);
+			if (v != current)
+			{
+				current = v;
+				const Viewport &target = viewports[v];
+				glViewport(target.x, target.y, target.width, target.height);
+				beginView(v);
+			}
+			if ((item.key >> KIND_SHIFT) & 1)
+			{
+				drawInstance(item.index, cameras[v].viewProjection);
+				continue;
+			}
+			SceneNode &node = scene.nodes[item.index];
+			Mesh &mesh = node.model->meshes[node.meshes[item.mesh]];
+			Shader &shader = variants.use(ShaderPermutation(sceneBasePermutation.features | mesh.features(), sceneBasePermutation.pointLights));
+			//the node matrices hold the projection of the main camera, the other views project here
+			ObjectTransform transform = node.transform;
+			transform.project(cameras[v].viewProjection);
+			transform.apply(shader);
+			mesh.draw(shader, node.lodLevels[item.mesh]);
+		}
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	//queueMs and drawMs are the cpu time of cull and buildQueue and the gpu time of submit
+	void report(std::ostream &out, double queueMs, double drawMs)
+	{
+		out << "views: " << stats.views << " views, " << stats.items << " queued draws, " << stats.tests << " frustum tests for "
+			<< stats.spheres << " spheres (" << stats.rejected << " outside every changed view), " << stats.reused
+			<< " views reused their culling, " << stats.shared << " shared another view's, queue " << queueMs << " ms, draw "
+			<< drawMs << " ms gpu" << std::endl;
+	}
+
+private:
+	//key bits from the top: view, kind (scene mesh or instance), shader features, distance
+	static const unsigned int VIEW_SHIFT = 60;
+	static const unsigned int KIND_SHIFT = 59;
+	static const unsigned int FEATURE_SHIFT = 32;
+
+	struct QueueItem {
+		unsigned long long key;
+		unsigned int index;	//scene node, or instance
+		unsigned int mesh;	//index into node.meshes
+	};
+
+	struct CachedView {
+		bool valid = false;
+		unsigned int version = 0;	//camera version of the bits
+		glm::vec4 bounds = glm::vec4(0.0f);	//sphere around the frustum, center and radius
+	};
+
+	vector<CachedView> cached;
+	vector<unsigned char> visible;
+	unsigned int cullSceneVersion = 0;
+	vector<QueueItem> queue;
+	ShaderPermutation sceneBasePermutation;
+
+	//sphere through the corners of the frustum, not the smallest one but cheap
+	static glm::vec4 frustumBounds(const glm::mat4 &viewProjection)
+	{
+		glm::mat4 inverse = glm::inverse(viewProjection);
+		glm::vec3 corners[8];
+		glm::vec3 center = glm::vec3(0.0f);
+		for (unsigned int c = 0; c < 8; ++c)
+		{
+			glm::vec4 corner = inverse * glm::vec4(c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, c & 4 ? 1.0f : -1.0f, 1.0f);
+			corners[c] = glm::vec3(corner) / corner.w;
+			center += corners[c] * 0.125f;
+		}
+		float radius = 0.0f;
+		for (const glm::vec3 &corner : corners)
+			radius = std::max(radius, glm::length(corner - center));
+		return glm::vec4(center, radius);
+	}
+
+	//smallest sphere around both spheres
+	static glm::vec4 enclose(const glm::vec4 &a, const glm::vec4 &b)
+	{
+		glm::vec3 offset = glm::vec3(b) - glm::vec3(a);
+		float distance = glm::length(offset);
+		if (distance + b.w <= a.w)
+			return a;
+		if (distance + a.w <= b.w)
+			return b;
+		float radius = 0.5f * (distance + a.w + b.w);
+		return glm::vec4(glm::vec3(a) + offset * ((radius - a.w) / distance), radius);
+	}
+
+	static bool overlaps(const glm::vec4 &a, const glm::vec4 &b)
+	{
+		glm::vec3 offset = glm::vec3(b) - glm::vec3(a);
+		float reach = a.w + b.w;
+		return glm::dot(offset, offset) <= reach * reach;
+	}
+
+	//the bits of a non-negative float sort like the float
+	static unsigned long long key(unsigned int view, unsigned int kind, unsigned int features, const glm::vec4 &sphere, const glm::vec3 &eye)
+	{
+		glm::vec3 offset = glm::vec3(sphere) - eye;
+		float distance2 = glm::dot(offset, offset);
+		unsigned int bits;
+		std::memcpy(&bits, &distance2, sizeof(bits));
+		return ((unsigned long long)view << VIEW_SHIFT) | ((unsigned long long)kind << KIND_SHIFT)
+			| ((unsigned long long)(features & 0x7ffffff) << FEATURE_SHIFT) | bits;
+	}
+};
\ No newline at end of file